@@ -3,7 +3,7 @@
 #
 ## (c) Milo Solutions, 2016
 
-QT = core
+QT = core concurrent
 
 # Warning! QStringBuilder can crash your app! See last point here:
 # https://www.kdab.com/uncovering-32-qt-best-practices-compile-time-clazy/
@@ -15,8 +15,25 @@ TEMPLATE = app
 CONFIG += c++14
 TARGET = gibs
 
+# Checksum algorithm. Built-in XXH64 is used by default, vectorized ones need
+# system libraries: CONFIG += xxh3 or CONFIG += blake3
+xxh3 {
+    DEFINES += GIBS_CHECKSUM_XXH3
+    LIBS += -lxxhash
+} else:blake3 {
+    DEFINES += GIBS_CHECKSUM_BLAKE3
+    LIBS += -lblake3
+}
+
 HEADERS += src/globals.h \
     src/fileparser.h \
+    src/prefilter.h \
+    src/parsedfileset.h \
+    src/parseresult.h \
+    src/checksum.h \
+    src/objectcache.h \
+    src/cachebundle.h \
+    src/fileindex.h \
     src/projectmanager.h \
     src/tags.h \
     src/flags.h \
@@ -31,6 +48,12 @@ HEADERS += src/globals.h \
 
 SOURCES += src/main.cpp \ 
     src/fileparser.cpp \
+    src/prefilter.cpp \
+    src/parsedfileset.cpp \
+    src/checksum.cpp \
+    src/objectcache.cpp \
+    src/cachebundle.cpp \
+    src/fileindex.cpp \
     src/projectmanager.cpp \
     src/fileinfo.cpp \
     src/metaprocess.cpp \
@@ -117,12 +117,15 @@ bool BaseParser::parseCommand(const QString &commandString)
             }
         }
     } else if (command == Tags::feature) {
-        const QStringList args(arguments.mid(1));
-        qDebug() << "Adding feature:" << args;
-        if (args.size() > 0) {
-            bool defaultOn = args.length() > 2? (args.at(2) == Tags::featureOn? true : false) : true;
-            emit feature(args.at(0), defaultOn);
+        qDebug() << "Adding feature:" << arguments.mid(1);
+        const Gibs::Feature declared(extractFeature(commandString));
+        if (!declared.name.isEmpty()) {
+            emit feature(declared.name, declared.enabled);
         }
+    } else if (command == Tags::unity) {
+        const bool isOn = (arguments.size() < 2 or arguments.at(1) != Tags::featureOff);
+        qDebug() << "Unity build for current file:" << isOn;
+        mScope->setUnityEnabled(isOn);
     } else if (command == Tags::version) {
         const QString &arg(arguments.at(1));
         const QVersionNumber ver(QVersionNumber::fromString(arg));
@@ -134,11 +137,33 @@ bool BaseParser::parseCommand(const QString &commandString)
     return true;
 }
 
+/*!
+ * If \a commandString is a feature command, returns the feature it declares,
+ * enabled if it is on by default. Otherwise, returns a feature with empty
+ * name.
+ */
+Gibs::Feature BaseParser::extractFeature(const QString &commandString)
+{
+    QStringList arguments(commandString.split(" ", QString::SkipEmptyParts));
+    if (!arguments.isEmpty() and (arguments.at(0) == Tags::scopeOneLine
+                                  or arguments.at(0) == Tags::scopeBegin))
+        arguments.removeFirst();
+
+    Gibs::Feature result;
+    if (arguments.size() < 2 or arguments.at(0) != Tags::feature)
+        return result;
+
+    result.name = arguments.at(1);
+    result.define = Gibs::normalizeFeatureName(result.name);
+    result.enabled = arguments.size() > 3? (arguments.at(3) == Tags::featureOn) : true;
+    return result;
+}
+
 /*!
  * Removes the gibs command \a tag from code \a line.
  */
 QString BaseParser::extractArguments(const QString &line,
-                                     const QLatin1String &tag) const
+                                     const QLatin1String &tag)
 {
     return line.mid(line.indexOf(tag) + tag.size() + 1);
 }
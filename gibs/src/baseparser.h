@@ -93,7 +93,8 @@ public slots:
 
 protected:
     bool parseCommand(const QString &commandString);
-    QString extractArguments(const QString &line, const QLatin1String &tag) const;
+    static Gibs::Feature extractFeature(const QString &commandString);
+    static QString extractArguments(const QString &line, const QLatin1String &tag);
 
     QPointer<Scope> mScope; // TODO: maybe BaseParser can inherit from Scope?
 };
@@ -0,0 +1,262 @@
+#include "cachebundle.h"
+
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <algorithm>
+#include <limits>
+
+#include <QDebug>
+
+namespace {
+const QByteArray magic("GIBSBNDL");
+const quint32 version = 1;
+// Magic, version, count, names offset, data offset
+const int headerSize = 8 + 4 + 4 + 8 + 8;
+// Name offset, name size, reserved, data offset, data size
+const int recordSize = 8 + 4 + 4 + 8 + 8;
+
+template<typename T>
+void append(QByteArray &data, const T value)
+{
+    uchar buffer[sizeof(T)];
+    qToLittleEndian<T>(value, buffer);
+    data.append(reinterpret_cast<const char *>(buffer), int(sizeof(T)));
+}
+}
+
+/*!
+ * Creates a bundle stored in file at \a path. Use addFile() and write() to
+ * create a new bundle, or open() to read an existing one.
+ */
+CacheBundle::CacheBundle(const QString &path) : mFile(path)
+{
+}
+
+/*!
+ * Schedules file at \a path to be put into the bundle under \a name. Files
+ * are read only when the bundle is written.
+ */
+void CacheBundle::addFile(const QString &name, const QString &path)
+{
+    mFiles.append(qMakePair(name, path));
+}
+
+/*!
+ * Writes all added files into the bundle. Returns false if any of them could
+ * not be read, or bundle could not be saved.
+ */
+bool CacheBundle::write()
+{
+    std::sort(mFiles.begin(), mFiles.end(),
+              [](const QPair<QString, QString> &left,
+                 const QPair<QString, QString> &right) {
+        return left.first.toUtf8() < right.first.toUtf8();
+    });
+    mFiles.erase(std::unique(mFiles.begin(), mFiles.end(),
+                             [](const QPair<QString, QString> &left,
+                                const QPair<QString, QString> &right) {
+        return left.first == right.first;
+    }), mFiles.end());
+
+    QByteArray names;
+    QVector<qint64> sizes;
+    for (const auto &file : qAsConst(mFiles)) {
+        const QFileInfo info(file.second);
+        if (!info.isFile()) {
+            qWarning() << "Cannot add file to cache bundle:" << file.second;
+            return false;
+        }
+        names.append(file.first.toUtf8());
+        sizes.append(info.size());
+    }
+
+    const quint64 namesOffset = quint64(headerSize + recordSize * mFiles.size());
+    const quint64 dataOffset = namesOffset + quint64(names.size());
+
+    QByteArray header(magic);
+    append<quint32>(header, version);
+    append<quint32>(header, quint32(mFiles.size()));
+    append<quint64>(header, namesOffset);
+    append<quint64>(header, dataOffset);
+
+    quint64 nameOffset = 0;
+    quint64 fileOffset = 0;
+    for (int i = 0; i < mFiles.size(); ++i) {
+        const quint32 nameSize = quint32(mFiles.at(i).first.toUtf8().size());
+        append<quint64>(header, nameOffset);
+        append<quint32>(header, nameSize);
+        append<quint32>(header, 0);
+        append<quint64>(header, fileOffset);
+        append<quint64>(header, quint64(sizes.at(i)));
+        nameOffset += nameSize;
+        fileOffset += quint64(sizes.at(i));
+    }
+
+    QSaveFile bundle(mFile.fileName());
+    if (!bundle.open(QFile::WriteOnly)) {
+        qWarning() << "Cannot open cache bundle for writing:" << mFile.fileName();
+        return false;
+    }
+
+    bundle.write(header);
+    bundle.write(names);
+
+    for (int i = 0; i < mFiles.size(); ++i) {
+        QFile file(mFiles.at(i).second);
+        if (!file.open(QFile::ReadOnly)) {
+            qWarning() << "Cannot read file:" << file.fileName();
+            bundle.cancelWriting();
+            return false;
+        }
+
+        // File has been changed in the meantime, the index would be wrong
+        const QByteArray data(file.readAll());
+        if (data.size() != sizes.at(i)) {
+            qWarning() << "File has changed while creating cache bundle:"
+                       << file.fileName();
+            bundle.cancelWriting();
+            return false;
+        }
+
+        bundle.write(data);
+    }
+
+    return bundle.commit();
+}
+
+/*!
+ * Opens and maps the bundle for reading. Returns false if the file cannot be
+ * read or is not a valid bundle.
+ */
+bool CacheBundle::open()
+{
+    if (!mFile.open(QFile::ReadOnly)) {
+        qWarning() << "Cannot open cache bundle:" << mFile.fileName();
+        return false;
+    }
+
+    mSize = mFile.size();
+    if (mSize < headerSize) {
+        qWarning() << "Cache bundle is too small:" << mFile.fileName();
+        return false;
+    }
+
+    mData = mFile.map(0, mSize);
+    if (mData == nullptr) {
+        qWarning() << "Cannot map cache bundle:" << mFile.fileName();
+        return false;
+    }
+
+    if (QByteArray::fromRawData(reinterpret_cast<const char *>(mData),
+                                magic.size()) != magic
+            or qFromLittleEndian<quint32>(mData + 8) != version) {
+        qWarning() << "Not a gibs cache bundle, or unknown version:"
+                   << mFile.fileName();
+        mData = nullptr;
+        return false;
+    }
+
+    const quint32 count = qFromLittleEndian<quint32>(mData + 12);
+    mNamesOffset = qFromLittleEndian<quint64>(mData + 16);
+    mDataOffset = qFromLittleEndian<quint64>(mData + 24);
+    const quint64 size = quint64(mSize);
+
+    // Check all offsets once, so that accessors do not have to
+    bool isValid = (quint64(headerSize) + quint64(count) * recordSize <= mNamesOffset
+                    and mNamesOffset <= mDataOffset and mDataOffset <= size);
+    for (quint32 i = 0; isValid and i < count; ++i) {
+        const uchar *entry = mData + headerSize + i * recordSize;
+        const quint64 nameOffset = qFromLittleEndian<quint64>(entry);
+        const quint64 nameSize = qFromLittleEndian<quint32>(entry + 8);
+        const quint64 dataOffset = qFromLittleEndian<quint64>(entry + 16);
+        const quint64 dataSize = qFromLittleEndian<quint64>(entry + 24);
+        isValid = (nameOffset <= mDataOffset - mNamesOffset
+                   and nameSize <= mDataOffset - mNamesOffset - nameOffset
+                   and dataOffset <= size - mDataOffset
+                   and dataSize <= size - mDataOffset - dataOffset
+                   and dataSize < quint64(std::numeric_limits<int>::max()));
+    }
+
+    if (!isValid) {
+        qWarning() << "Cache bundle is corrupted:" << mFile.fileName();
+        mData = nullptr;
+        return false;
+    }
+
+    mCount = int(count);
+    return true;
+}
+
+/*!
+ * Returns number of files in an opened bundle.
+ */
+int CacheBundle::count() const
+{
+    return mCount;
+}
+
+QString CacheBundle::name(const int index) const
+{
+    return QString::fromUtf8(rawName(index));
+}
+
+/*!
+ * Returns contents of file at \a index. Data is not copied, it is valid as
+ * long as the bundle exists.
+ */
+QByteArray CacheBundle::data(const int index) const
+{
+    const uchar *entry = record(index);
+    if (entry == nullptr)
+        return QByteArray();
+
+    const quint64 offset = mDataOffset + qFromLittleEndian<quint64>(entry + 16);
+    const quint64 size = qFromLittleEndian<quint64>(entry + 24);
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(mData + offset),
+                                   int(size));
+}
+
+/*!
+ * Returns index of file with \a name, or -1 if bundle does not contain it.
+ */
+int CacheBundle::indexOf(const QString &name) const
+{
+    const QByteArray key(name.toUtf8());
+    int first = 0;
+    int last = mCount - 1;
+    while (first <= last) {
+        const int middle = first + (last - first) / 2;
+        const QByteArray current(rawName(middle));
+        if (current == key)
+            return middle;
+
+        if (current < key) {
+            first = middle + 1;
+        } else {
+            last = middle - 1;
+        }
+    }
+
+    return -1;
+}
+
+QByteArray CacheBundle::rawName(const int index) const
+{
+    const uchar *entry = record(index);
+    if (entry == nullptr)
+        return QByteArray();
+
+    const quint64 offset = mNamesOffset + qFromLittleEndian<quint64>(entry);
+    const quint32 size = qFromLittleEndian<quint32>(entry + 8);
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(mData + offset),
+                                   int(size));
+}
+
+const uchar *CacheBundle::record(const int index) const
+{
+    if (mData == nullptr or index < 0 or index >= mCount)
+        return nullptr;
+    return mData + headerSize + index * recordSize;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QPair>
+#include <QFile>
+
+/*!
+ * \brief The CacheBundle class packs many cache files into a single file, so
+ * that caches can be moved between machines (for example from nightly CI to
+ * developers).
+ *
+ * Bundle layout (all numbers are little endian):
+ * - header: magic, version, number of files, offset of names, offset of data
+ * - index: one fixed size record per file, sorted by name: name offset and
+ *   size, data offset and size
+ * - names (UTF-8)
+ * - data
+ *
+ * When reading, the bundle is memory mapped. Files can be found with a binary
+ * search over the index and their data is not copied.
+ */
+class CacheBundle
+{
+public:
+    explicit CacheBundle(const QString &path);
+
+    void addFile(const QString &name, const QString &path);
+    bool write();
+
+    bool open();
+    int count() const;
+    QString name(const int index) const;
+    QByteArray data(const int index) const;
+    int indexOf(const QString &name) const;
+
+protected:
+    QByteArray rawName(const int index) const;
+    const uchar *record(const int index) const;
+
+    QFile mFile;
+    // Name in bundle, path on disk
+    QVector<QPair<QString, QString>> mFiles;
+
+    const uchar *mData = nullptr;
+    qint64 mSize = 0;
+    int mCount = 0;
+    quint64 mNamesOffset = 0;
+    quint64 mDataOffset = 0;
+};
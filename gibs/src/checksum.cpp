@@ -0,0 +1,169 @@
+#include "checksum.h"
+
+#include <QFile>
+#include <QtEndian>
+
+#if defined(GIBS_CHECKSUM_XXH3)
+#include <xxhash.h>
+#elif defined(GIBS_CHECKSUM_BLAKE3)
+#include <blake3.h>
+#else
+namespace {
+const quint64 prime1 = 0x9E3779B185EBCA87ULL;
+const quint64 prime2 = 0xC2B2AE3D27D4EB4FULL;
+const quint64 prime3 = 0x165667B19E3779F9ULL;
+const quint64 prime4 = 0x85EBCA77C2B2AE63ULL;
+const quint64 prime5 = 0x27D4EB2F165667C5ULL;
+
+inline quint64 rotateLeft(const quint64 value, const int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline quint64 read64(const uchar *data)
+{
+    return qFromLittleEndian<quint64>(data);
+}
+
+inline quint64 read32(const uchar *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+inline quint64 xxhRound(quint64 accumulator, const quint64 input)
+{
+    accumulator += input * prime2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * prime1;
+}
+
+inline quint64 mergeRound(quint64 accumulator, const quint64 value)
+{
+    accumulator ^= xxhRound(0, value);
+    return accumulator * prime1 + prime4;
+}
+
+/*!
+ * XXH64 with seed 0. See https://github.com/Cyan4973/xxHash for the
+ * specification.
+ */
+quint64 xxh64(const uchar *data, const quint64 size)
+{
+    const uchar *const end = data + size;
+    quint64 result;
+
+    if (size >= 32) {
+        const uchar *const limit = end - 32;
+        quint64 v1 = prime1 + prime2;
+        quint64 v2 = prime2;
+        quint64 v3 = 0;
+        quint64 v4 = 0 - prime1;
+
+        do {
+            v1 = xxhRound(v1, read64(data));
+            v2 = xxhRound(v2, read64(data + 8));
+            v3 = xxhRound(v3, read64(data + 16));
+            v4 = xxhRound(v4, read64(data + 24));
+            data += 32;
+        } while (data <= limit);
+
+        result = rotateLeft(v1, 1) + rotateLeft(v2, 7)
+                + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        result = mergeRound(result, v1);
+        result = mergeRound(result, v2);
+        result = mergeRound(result, v3);
+        result = mergeRound(result, v4);
+    } else {
+        result = prime5;
+    }
+
+    result += size;
+
+    while (data + 8 <= end) {
+        result ^= xxhRound(0, read64(data));
+        result = rotateLeft(result, 27) * prime1 + prime4;
+        data += 8;
+    }
+
+    if (data + 4 <= end) {
+        result ^= read32(data) * prime1;
+        result = rotateLeft(result, 23) * prime2 + prime3;
+        data += 4;
+    }
+
+    while (data < end) {
+        result ^= (*data) * prime5;
+        result = rotateLeft(result, 11) * prime1;
+        ++data;
+    }
+
+    result ^= result >> 33;
+    result *= prime2;
+    result ^= result >> 29;
+    result *= prime3;
+    result ^= result >> 32;
+    return result;
+}
+}
+#endif
+
+/*!
+ * Returns checksum of \a size bytes of \a data.
+ */
+QByteArray Checksum::hash(const char *data, const qint64 size)
+{
+#if defined(GIBS_CHECKSUM_XXH3)
+    XXH128_canonical_t canonical;
+    XXH128_canonicalFromHash(&canonical, XXH3_128bits(data, size_t(size)));
+    return QByteArray(reinterpret_cast<const char *>(canonical.digest),
+                      int(sizeof(canonical.digest)));
+#elif defined(GIBS_CHECKSUM_BLAKE3)
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, data, size_t(size));
+    QByteArray result(BLAKE3_OUT_LEN, Qt::Uninitialized);
+    blake3_hasher_finalize(&hasher, reinterpret_cast<uint8_t *>(result.data()),
+                           BLAKE3_OUT_LEN);
+    return result;
+#else
+    QByteArray result(int(sizeof(quint64)), Qt::Uninitialized);
+    qToBigEndian<quint64>(xxh64(reinterpret_cast<const uchar *>(data),
+                                quint64(size)), result.data());
+    return result;
+#endif
+}
+
+/*!
+ * Returns checksum of contents of file at \a path, or an empty array if
+ * the file cannot be read.
+ */
+QByteArray Checksum::fileHash(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly))
+        return QByteArray();
+
+    const qint64 size = file.size();
+    if (size > 0) {
+        const uchar *data = file.map(0, size);
+        if (data != nullptr)
+            return hash(reinterpret_cast<const char *>(data), size);
+    }
+
+    const QByteArray contents(file.readAll());
+    return hash(contents.constData(), contents.size());
+}
+
+/*!
+ * Returns the name of checksum algorithm gibs has been built with.
+ */
+QLatin1String Checksum::algorithm()
+{
+#if defined(GIBS_CHECKSUM_XXH3)
+    return QLatin1String("xxh3-128");
+#elif defined(GIBS_CHECKSUM_BLAKE3)
+    return QLatin1String("blake3");
+#else
+    return QLatin1String("xxh64");
+#endif
+}
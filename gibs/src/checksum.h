@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QLatin1String>
+
+/*!
+ * Checksum computes content hashes of source files. They are stored in gibs
+ * cache and used to find out if a file has really changed.
+ *
+ * Hashes do not need to be cryptographically strong, only fast. The algorithm
+ * is chosen at build time:
+ * - CONFIG += xxh3 uses XXH3-128 from system xxhash library
+ * - CONFIG += blake3 uses BLAKE3 from system blake3 library
+ * - by default, built-in XXH64 is used
+ *
+ * Name of the algorithm is saved in the cache, so that checksums made by a
+ * different gibs build are not compared with each other.
+ */
+namespace Checksum {
+QByteArray hash(const char *data, const qint64 size);
+QByteArray fileHash(const QString &path);
+QLatin1String algorithm();
+}
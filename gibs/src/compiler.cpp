@@ -19,6 +19,15 @@ QJsonObject Compiler::toJson() const
                   QJsonArray::fromStringList(debugFlags));
     object.insert(Tags::compilerReleaseFlags,
                   QJsonArray::fromStringList(releaseFlags));
+    object.insert(Tags::compilerDepfileFlags,
+                  QJsonArray::fromStringList(depfileFlags));
+    object.insert(Tags::compilerPrefixMapFlags,
+                  QJsonArray::fromStringList(prefixMapFlags));
+    object.insert(Tags::compilerPchFlags, QJsonArray::fromStringList(pchFlags));
+    object.insert(Tags::compilerPchSuffix, pchSuffix);
+    object.insert(Tags::compilerMultiDepfileFlags,
+                  QJsonArray::fromStringList(multiDepfileFlags));
+    object.insert(Tags::compilerResponseFileFlag, responseFileFlag);
     object.insert(Tags::linker, linker);
     object.insert(Tags::staticArchiver, staticArchiver);
     object.insert(Tags::libraryPrefix, libraryPrefix);
@@ -46,6 +55,30 @@ Compiler Compiler::fromJson(const QJsonObject &json)
                 json.value(Tags::compilerDebugFlags).toArray());
     compiler.releaseFlags = Gibs::jsonArrayToStringList(
                 json.value(Tags::compilerReleaseFlags).toArray());
+    // Older compiler definitions do not have it, keep the default then
+    if (json.contains(Tags::compilerDepfileFlags)) {
+        compiler.depfileFlags = Gibs::jsonArrayToStringList(
+                    json.value(Tags::compilerDepfileFlags).toArray());
+    }
+    if (json.contains(Tags::compilerPrefixMapFlags)) {
+        compiler.prefixMapFlags = Gibs::jsonArrayToStringList(
+                    json.value(Tags::compilerPrefixMapFlags).toArray());
+    }
+    if (json.contains(Tags::compilerPchFlags)) {
+        compiler.pchFlags = Gibs::jsonArrayToStringList(
+                    json.value(Tags::compilerPchFlags).toArray());
+    }
+    if (json.contains(Tags::compilerPchSuffix)) {
+        compiler.pchSuffix = json.value(Tags::compilerPchSuffix).toString();
+    }
+    if (json.contains(Tags::compilerMultiDepfileFlags)) {
+        compiler.multiDepfileFlags = Gibs::jsonArrayToStringList(
+                    json.value(Tags::compilerMultiDepfileFlags).toArray());
+    }
+    if (json.contains(Tags::compilerResponseFileFlag)) {
+        compiler.responseFileFlag = json.value(
+                    Tags::compilerResponseFileFlag).toString();
+    }
     compiler.linker = json.value(Tags::linker).toString();
     compiler.staticArchiver = json.value(Tags::staticArchiver).toString();
     compiler.libraryPrefix = json.value(Tags::libraryPrefix).toString();
@@ -25,6 +25,23 @@ struct Compiler
     QStringList flags = { "-c", "-pipe", "-D_REENTRANT", "-fPIC", "-Wall", "-W", };
     QStringList debugFlags = { "-g" };
     QStringList releaseFlags = { "-O2" };
+    // Make compiler write a depfile, %1 is replaced with depfile path
+    QStringList depfileFlags = { "-MMD", "-MF", "%1" };
+    // Strip a directory from paths embedded in objects, %1 is replaced with
+    // the directory and %2 with its replacement
+    QStringList prefixMapFlags = { "-ffile-prefix-map=%1=%2" };
+    // Compile a header into precompiled header. Compiler picks it up
+    // automatically when header is included with -include and a file with
+    // pchSuffix appended to header name exists
+    QStringList pchFlags = { "-x", "c++-header" };
+    QString pchSuffix = ".gch";
+    // Depfile flags used when several sources are compiled by one compiler
+    // call. Depfiles are then named after object files. Empty if compiler
+    // can't do that
+    QStringList multiDepfileFlags = { "-MMD" };
+    // Read arguments from a file, %1 is replaced with file path. Empty if
+    // compiler does not support response files
+    QString responseFileFlag = "@%1";
 
     QString linker = "g++";
     QString staticArchiver = "ar";
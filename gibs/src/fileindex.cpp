@@ -0,0 +1,148 @@
+#include "fileindex.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+
+#include <QDebug>
+
+/*!
+ * Indexes directory tree starting at \a root. Directories which have not
+ * changed since the index was last updated (or loaded from cache) are not
+ * read again.
+ */
+void FileIndex::update(const QString &root)
+{
+    const QString currentDir(QDir::currentPath());
+    QHash<QString, Directory> directories;
+    QStringList queue { QDir::cleanPath(root) };
+    int readCount = 0;
+
+    while (!queue.isEmpty()) {
+        const QString path(queue.takeLast());
+        const Gibs::FileStat stat(Gibs::fileStat(path));
+        if (!stat.isValid())
+            continue;
+
+        Directory directory;
+        const auto it = mDirectories.constFind(path);
+        if (it != mDirectories.constEnd() and it->stat == stat) {
+            directory = it.value();
+        } else {
+            directory = readDirectory(path, stat);
+            ++readCount;
+        }
+
+        for (const QString &subdir : qAsConst(directory.subdirs)) {
+            queue.append(path == "."? subdir : path + "/" + subdir);
+        }
+
+        // Generated files appear in current dir during the build
+        if (QDir(path).absolutePath() != currentDir)
+            directories.insert(path, directory);
+    }
+
+    mDirectories = directories;
+    qDebug() << "File index:" << mDirectories.size() << "directories,"
+             << readCount << "read from disk";
+}
+
+/*!
+ * Returns true if file (or directory) at \a path exists. Answer comes from
+ * the index if \a path is inside of it, from disk otherwise.
+ */
+bool FileIndex::exists(const QString &path) const
+{
+    const QString cleanPath(QDir::cleanPath(path));
+    const int slash = cleanPath.lastIndexOf('/');
+    const QString directory(slash < 0? QString(".")
+                                     : (slash == 0? QString("/")
+                                                  : cleanPath.left(slash)));
+
+    const auto it = mDirectories.constFind(directory);
+    if (it == mDirectories.constEnd())
+        return QFileInfo::exists(path);
+
+    return it->entries.contains(cleanPath.mid(slash + 1));
+}
+
+/*!
+ * Returns true if \a file (relative path, like "foo/bar.h") exists in any
+ * indexed directory under \a root (including \a root itself).
+ */
+bool FileIndex::containsUnder(const QString &root, const QString &file) const
+{
+    const QString cleanRoot(QDir::cleanPath(root));
+    const QString rootPrefix(cleanRoot + "/");
+    for (auto it = mDirectories.constBegin(); it != mDirectories.constEnd(); ++it) {
+        if (cleanRoot != "." and it.key() != cleanRoot
+                and !it.key().startsWith(rootPrefix))
+            continue;
+
+        const QString path(QDir::cleanPath(it.key() + "/" + file));
+        const int slash = path.lastIndexOf('/');
+        const auto directory = mDirectories.constFind(path.left(slash));
+        if (directory != mDirectories.constEnd()
+                and directory->entries.contains(path.mid(slash + 1)))
+            return true;
+    }
+
+    return false;
+}
+
+QJsonObject FileIndex::toJson() const
+{
+    QJsonObject object;
+    for (auto it = mDirectories.constBegin(); it != mDirectories.constEnd(); ++it) {
+        QStringList entries;
+        for (const QString &entry : qAsConst(it->entries))
+            entries.append(entry);
+        entries.sort();
+
+        object.insert(it.key(), QJsonArray {
+                          QString::number(it->stat.inode),
+                          QString::number(it->stat.size),
+                          QString::number(it->stat.modified),
+                          QJsonArray::fromStringList(entries),
+                          QJsonArray::fromStringList(it->subdirs)
+                      });
+    }
+    return object;
+}
+
+void FileIndex::fromJson(const QJsonObject &json)
+{
+    mDirectories.clear();
+    for (auto it = json.constBegin(); it != json.constEnd(); ++it) {
+        const QJsonArray array(it.value().toArray());
+        if (array.size() < 5)
+            continue;
+
+        Directory directory;
+        directory.stat.inode = array.at(0).toString().toULongLong();
+        directory.stat.size = array.at(1).toString().toLongLong();
+        directory.stat.modified = array.at(2).toString().toLongLong();
+        const QStringList entries(Gibs::jsonArrayToStringList(array.at(3).toArray()));
+        for (const QString &entry : entries)
+            directory.entries.insert(entry);
+        directory.subdirs = Gibs::jsonArrayToStringList(array.at(4).toArray());
+        mDirectories.insert(it.key(), directory);
+    }
+}
+
+FileIndex::Directory FileIndex::readDirectory(const QString &path,
+                                              const Gibs::FileStat &stat)
+{
+    const QDir dir(path);
+    Directory directory;
+    directory.stat = stat;
+
+    const QStringList entries(dir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot));
+    for (const QString &entry : entries)
+        directory.entries.insert(entry);
+
+    // Symlinks are not followed, they can form cycles
+    directory.subdirs = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot
+                                      | QDir::NoSymLinks);
+    return directory;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "gibs.h"
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QJsonObject>
+#include <QSharedPointer>
+
+class FileIndex;
+
+using FileIndexPtr = QSharedPointer<FileIndex>;
+
+/*!
+ * \brief The FileIndex class keeps names of all files in the project tree in
+ * memory, so that looking for includes and sources does not have to ask the
+ * filesystem for every include dir and every file extension.
+ *
+ * Index is stored in gibs cache. On next run, only directories whose
+ * modification time has changed are read again (adding, removing or renaming
+ * a file changes modification time of its directory).
+ *
+ * Paths outside of the project tree, and in current directory (gibs writes
+ * generated files there during the build), are checked on disk.
+ *
+ * Index is not modified while files are being scanned, so it can be used
+ * from many threads at once.
+ */
+class FileIndex
+{
+public:
+    void update(const QString &root);
+    bool exists(const QString &path) const;
+    bool containsUnder(const QString &root, const QString &file) const;
+
+    QJsonObject toJson() const;
+    void fromJson(const QJsonObject &json);
+
+protected:
+    struct Directory {
+        Gibs::FileStat stat;
+        // Names of all files and subdirectories
+        QSet<QString> entries;
+        QStringList subdirs;
+    };
+
+    static Directory readDirectory(const QString &path,
+                                   const Gibs::FileStat &stat);
+
+    // Clean path, contents
+    QHash<QString, Directory> mDirectories;
+};
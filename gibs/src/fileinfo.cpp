@@ -1,4 +1,6 @@
 #include "fileinfo.h"
+#include "tags.h"
+#include "gibs.h"
 
 #include <QMetaObject>
 #include <QMetaEnum>
@@ -8,6 +10,24 @@ bool FileInfo::isEmpty() const
     return (path.isEmpty() and checksum.isEmpty());
 }
 
+/*!
+ * Returns the results of last scan of this file, as stored in cache. They can
+ * be used by FileParser::scan() instead of scanning the file again, if its
+ * contents did not change.
+ */
+ParseResult FileInfo::toParseResult() const
+{
+    ParseResult result;
+    result.file = path;
+    result.source = source;
+    result.events = events;
+    result.checksum = checksum;
+    result.stat = stat;
+    result.modified = dateModified;
+    result.created = dateCreated;
+    return result;
+}
+
 QJsonArray FileInfo::toJsonArray() const
 {
     QJsonArray result;
@@ -20,6 +40,15 @@ QJsonArray FileInfo::toJsonArray() const
     result.insert(i++, generatedFile);
     result.insert(i++, generatedObjectFile);
     result.insert(i++, fileTypeToString(type));
+    result.insert(i++, stat.size);
+    result.insert(i++, source);
+    result.insert(i++, eventsToJsonArray(events));
+    // Stored as strings, they do not fit into double
+    result.insert(i++, QString::number(stat.inode));
+    result.insert(i++, QString::number(stat.modified));
+    result.insert(i++, QJsonArray::fromStringList(dependencies));
+    result.insert(i++, compileTime);
+    result.insert(i++, QJsonArray::fromStringList(generatedDependencies));
     return result;
 }
 
@@ -34,6 +63,15 @@ void FileInfo::fromJsonArray(const QJsonArray &array)
     generatedFile = array.at(i++).toString();
     generatedObjectFile = array.at(i++).toString();
     type = stringToFileType(array.at(i++).toString());
+    // Caches saved by older gibs versions do not have scan results
+    stat.size = qint64(array.at(i++).toDouble(-1));
+    source = array.at(i++).toString();
+    events = jsonArrayToEvents(array.at(i++).toArray());
+    stat.inode = array.at(i++).toString().toULongLong();
+    stat.modified = array.at(i++).toString().toLongLong();
+    dependencies = Gibs::jsonArrayToStringList(array.at(i++).toArray());
+    compileTime = qint64(array.at(i++).toDouble(-1));
+    generatedDependencies = Gibs::jsonArrayToStringList(array.at(i++).toArray());
 }
 
 QString FileInfo::fileTypeToString(const FileInfo::FileType type) const
@@ -49,3 +87,53 @@ FileInfo::FileType FileInfo::stringToFileType(const QString &type) const
     const auto enumerator = smo.enumerator(smo.indexOfEnumerator("FileType"));
     return FileType(enumerator.keyToValue(type.toLatin1().constData()));
 }
+
+/*!
+ * Events are stored as pairs: type and value. MOC events have no value.
+ */
+QJsonArray FileInfo::eventsToJsonArray(const QVector<ParseResult::Event> &events)
+{
+    QJsonArray result;
+    for (const auto &event : events) {
+        switch (event.type) {
+        case ParseResult::Include:
+            result.append(Tags::eventInclude);
+            break;
+        case ParseResult::Command:
+            result.append(Tags::eventCommand);
+            break;
+        case ParseResult::Moc:
+            result.append(Tags::eventMoc);
+            break;
+        case ParseResult::LibraryInclude:
+            result.append(Tags::eventLibraryInclude);
+            break;
+        case ParseResult::Define:
+            result.append(Tags::eventDefine);
+            break;
+        }
+        result.append(event.value);
+    }
+    return result;
+}
+
+QVector<ParseResult::Event> FileInfo::jsonArrayToEvents(const QJsonArray &array)
+{
+    QVector<ParseResult::Event> result;
+    for (int i = 0; i + 1 < array.size(); i += 2) {
+        const QString type(array.at(i).toString());
+        const QString value(array.at(i + 1).toString());
+        if (type == Tags::eventInclude) {
+            result.append(ParseResult::Event { ParseResult::Include, value });
+        } else if (type == Tags::eventCommand) {
+            result.append(ParseResult::Event { ParseResult::Command, value });
+        } else if (type == Tags::eventMoc) {
+            result.append(ParseResult::Event { ParseResult::Moc, value });
+        } else if (type == Tags::eventLibraryInclude) {
+            result.append(ParseResult::Event { ParseResult::LibraryInclude, value });
+        } else if (type == Tags::eventDefine) {
+            result.append(ParseResult::Event { ParseResult::Define, value });
+        }
+    }
+    return result;
+}
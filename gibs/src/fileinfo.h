@@ -4,6 +4,9 @@
 #include <QString>
 #include <QDateTime>
 #include <QJsonArray>
+#include <QVector>
+
+#include "parseresult.h"
 
 /*!
  * \brief The FileInfo class contains information about a single compilation
@@ -29,18 +32,32 @@ public:
     QDateTime dateModified;
     QDateTime dateCreated;
     QByteArray checksum;
+    // Inode, size and modification time, for quick change detection
+    Gibs::FileStat stat;
     // if --pipe flag is used, this will contain full file contents
     QByteArray contents;
+    // Results of the last scan: source file and includes, commands, MOC
+    QString source;
+    QVector<ParseResult::Event> events;
+    // All files object file depends on, as reported by the compiler
+    QStringList dependencies;
+    // The same for generated object file
+    QStringList generatedDependencies;
+    // How long compilation took in last build, in ms. -1 if not known
+    qint64 compileTime = -1;
     QString objectFile;
     QString generatedFile;
     QString generatedObjectFile;
     FileType type;
 
     bool isEmpty() const;
+    ParseResult toParseResult() const;
     QJsonArray toJsonArray() const;
     void fromJsonArray(const QJsonArray &array);
 
 private:
     QString fileTypeToString(const FileType type) const;
     FileType stringToFileType(const QString &type) const;
+    static QJsonArray eventsToJsonArray(const QVector<ParseResult::Event> &events);
+    static QVector<ParseResult::Event> jsonArrayToEvents(const QJsonArray &array);
 };
@@ -1,14 +1,83 @@
 #include "fileparser.h"
+#include "prefilter.h"
+#include "checksum.h"
 #include "tags.h"
 
 #include <QDateTime>
 #include <QFile>
 #include <QFileInfo>
-#include <QCryptographicHash>
+
+#include <cstring>
 
 // TODO: add categorized logging!
 #include <QDebug>
 
+/*!
+ * Returns true for the same characters which QByteArray::trimmed() removes.
+ */
+static inline bool isSpace(const char character)
+{
+    return (character == ' ' or character == '\t' or character == '\n'
+            or character == '\r' or character == '\v' or character == '\f');
+}
+
+/*!
+ * Returns true if \a line starts with \a tag. Unlike QByteArray::startsWith(),
+ * \a tag does not need to be null-terminated.
+ */
+static inline bool startsWith(const QByteArray &line, const QLatin1String &tag)
+{
+    return (line.size() >= tag.size()
+            and std::memcmp(line.constData(), tag.data(), size_t(tag.size())) == 0);
+}
+
+/*!
+ * Splits preprocessor directive \a line into words. Words like "#", "!",
+ * "defined" or "(" are glued together with the word which follows them.
+ *
+ * Words which do not need to be glued point directly into \a line data - no
+ * copy is made for them. Result always contains at least one (possibly empty)
+ * word.
+ */
+static QVector<QByteArray> directiveWords(const QByteArray &line)
+{
+    QVector<QByteArray> words;
+    const char *current = line.constData();
+    const char *const end = current + line.size();
+    bool glue = false;
+
+    while (current < end) {
+        while (current < end and *current == ' ')
+            ++current;
+
+        const char *wordEnd = current;
+        while (wordEnd < end and *wordEnd != ' ')
+            ++wordEnd;
+
+        if (current == wordEnd)
+            break;
+
+        const QByteArray word(QByteArray::fromRawData(
+                                  current, int(wordEnd - current)));
+        // TODO: support line breaks by backslashes
+        if (glue) {
+            words.last() = words.last() + word;
+            glue = false;
+        } else {
+            words.append(word);
+            glue = (word == "#" or word == "!" or word == "defined"
+                    or word == "(");
+        }
+
+        current = wordEnd;
+    }
+
+    if (words.isEmpty())
+        words.append(QByteArray());
+
+    return words;
+}
+
 /*!
  * Sets up the FileParser to parse \a file within the compilation \a scope.
  * If \a parseWholeFiles is set, gibs will not stop parsing after encountering
@@ -31,44 +100,129 @@ FileParser::FileParser(const QString &file, const bool parseWholeFiles,
  * If gibs is run with `--pipe` flag or parseWholeFiles is set, this method will
  * also store the whole file contents. It can then be used to feed directly into
  * the compiler, without it needing to open the file again.
+ *
+ * \sa scan, apply
  */
 bool FileParser::parse()
- {
-    QFile file(mFile);
-    if (mFile.isEmpty() or !file.exists()) {
-        emit error(QString("File %1 does not exist").arg(mFile));
-        return false;
+{
+    return apply(scan(mFile, mParseWholeFiles, mScope->features()));
+}
+
+/*!
+ * Scans C++ \a file and returns everything gibs needs to know about it:
+ * includes, gibs commands, MOC markers and source file name. \a features are
+ * used to decide which ifdef blocks are active. Features declared in the file
+ * itself count from the line where they are declared (with values from
+ * \a features taking precedence, like in Scope::onFeature()). If
+ * \a parseWholeFiles is set, gibs will not stop scanning after encountering
+ * real code.
+ *
+ * The file is memory-mapped and scanned in place, line by line, as raw bytes.
+ * QStrings are only created for data which is actually extracted: include
+ * names, defines used in ifdefs and gibs commands.
+ *
+ * If \a cached result of a previous scan has the same size and checksum as
+ * the file has now, the file is not scanned again: \a cached is returned, with
+ * updated dates (and contents, if needed).
+ *
+ * Source file of a header is looked up in \a fileIndex, if it is set.
+ *
+ * This method does not touch any Scope and is safe to call from multiple
+ * threads at once. The result is acted upon later, by apply().
+ */
+ParseResult FileParser::scan(const QString &file, const bool parseWholeFiles,
+                             const QHash<QString, Gibs::Feature> &features,
+                             const ParseResult &cached,
+                             const FileIndex *fileIndex)
+{
+    ParseResult result;
+    result.file = file;
+
+    QFile input(file);
+    if (file.isEmpty() or !input.exists()) {
+        result.error = QString("File %1 does not exist").arg(file);
+        return result;
     }
 
-    if (!file.open(QFile::ReadOnly | QFile::Text)) {
-        emit error(QString("File %1 could not be opened for reading!").arg(mFile));
-        return false;
+    if (!input.open(QFile::ReadOnly)) {
+        result.error = QString("File %1 could not be opened for reading!").arg(file);
+        return result;
+    }
+
+    // QFile::map() fails for empty files and on some special file systems.
+    // Fall back to reading the whole file in one go then
+    QByteArray buffer;
+    const char *data = nullptr;
+    qint64 size = input.size();
+    if (size > 0) {
+        data = reinterpret_cast<const char *>(input.map(0, size));
+        if (data == nullptr) {
+            buffer = input.readAll();
+            data = buffer.constData();
+            size = buffer.size();
+        }
+    }
+    const char *const end = data + size;
+
+    const QFileInfo header(file);
+    result.stat = Gibs::fileStat(file);
+    result.checksum = Checksum::hash(data, size);
+    result.modified = header.lastModified();
+    result.created = header.created();
+    // TODO: use separate flag for saving whole file data
+    if (parseWholeFiles == true)
+        result.contents = QByteArray(data, int(size));
+
+    // Only timestamps have changed (git checkout, touch) - reuse old results
+    if (cached.stat.size == result.stat.size
+            and cached.checksum == result.checksum) {
+        qInfo() << "Restoring from cache:" << file;
+        result.source = cached.source;
+        result.events = cached.events;
+        return result;
     }
 
-    qInfo() << "Parsing:" << mFile;
+    qInfo() << "Parsing:" << file;
 
     ParseBlock block;
     block.active = block.defined;
-    QString source;
-    QByteArray rawContents;
-    QCryptographicHash checksum(QCryptographicHash::Sha1);
-    // Cache:
-    int scopeFeatureCount = mScope->features().count();
-    int previousFeatureCount = 0;
-
-    //QTextStream in(&file);
-    while (!file.atEnd()) {
+    for (const auto &feature : features) {
+        if (!block.defined.contains(feature.define)) {
+            block.defined.insert(feature.define, feature.enabled);
+        }
+    }
+
+    // Macro checked by last #ifndef, possibly an include guard
+    QByteArray guard;
+    const char *next = data;
+    while (next < end) {
+        // When parsing whole files, jump straight to lines which can contain
+        // something interesting. Lines inside gibs comment blocks are always
+        // parsed
+        if (parseWholeFiles == true and block.isComment == false) {
+            next = Prefilter::nextCandidateLine(next, end);
+            if (next == end)
+                break;
+        }
+
+        const char *lineBegin = next;
+        const char *lineEnd = static_cast<const char *>(
+                    std::memchr(lineBegin, '\n', size_t(end - lineBegin)));
+        next = (lineEnd == nullptr)? end : lineEnd + 1;
+        if (lineEnd == nullptr)
+            lineEnd = end;
+
         // We remove any leading and trailing whitespace for simplicity
-        const QByteArray rawLine(file.readLine());
-        const QString line(rawLine.trimmed());
-
-        if (mParseWholeFiles == true) {
-            // TODO: what to do with checksum if we are not parsing whole files?
-            // Most probably this needs to be removed.
-            checksum.addData(rawLine);
-            // TODO: use separate flag for saving whole file data
-            rawContents.append(rawLine);
-        } else {
+        while (lineBegin < lineEnd and isSpace(*lineBegin))
+            ++lineBegin;
+        while (lineEnd > lineBegin and isSpace(*(lineEnd - 1)))
+            --lineEnd;
+
+        // No copy is made here, line points directly into mapped memory
+        const QByteArray line(QByteArray::fromRawData(
+                                  lineBegin, int(lineEnd - lineBegin)));
+
+        if (parseWholeFiles == false) {
             // TODO: make "real code" detector more robust
             if (line.contains("::") or line.contains(" class "))
                 break;
@@ -79,37 +233,22 @@ bool FileParser::parse()
         if (line.startsWith('#')) {
             // If this is an ifdef line, we don't need to do any further parsing
             bool skipParsing = true;
-            const QStringList w(line.split(' ', QString::SkipEmptyParts));
-            QStringList words;
-
-            // TODO: if new define was added, we should update block.active
-            // and block.defined here!
-            scopeFeatureCount = mScope->features().count();
-            if (scopeFeatureCount != previousFeatureCount) {
-                previousFeatureCount = scopeFeatureCount;
-                const auto &features = mScope->features().values();
-                for (const auto &feature : features) {
-                    if (!block.defined.contains(feature.define)) {
-                        block.defined.insert(feature.define, feature.enabled);
-                    }
+            const QVector<QByteArray> words(directiveWords(line));
+
+            if (words.at(0) == "#ifndef" and words.size() > 1) {
+                guard = words.at(1);
+            } else if ((words.at(0) == "#define" or words.at(0) == "#undef")
+                       and words.size() > 1) {
+                const bool isGuard = (words.at(0) == "#define"
+                                      and words.size() == 2
+                                      and words.at(1) == guard);
+                if (!isGuard) {
+                    result.events.append(ParseResult::Event {
+                        ParseResult::Define, QString::fromUtf8(words.at(1))
+                    });
                 }
             }
 
-            // Glue words together
-            for (int i = 0; i < w.length(); ++i) {
-                // TODO: support line breaks by backslashes
-                if ((i < w.length() - 1) and
-                        (w.at(i) == '#' or w.at(i) == '!'
-                         or w.at(i) == "defined" or w.at(i) == "("))
-                {
-                    words.append(w.at(i) + w.at(i + 1));
-                    ++i;
-                    continue;
-                }
-
-                words.append(w.at(i));
-            }
-
             if (words.at(0) == "#ifdef" or words.at(0) == "#elif") {
                 // #ifdef STH
                 // #ifdef ! STH
@@ -118,8 +257,8 @@ bool FileParser::parse()
                     block.active.insert(key, false);
                 }
 
-                if (words.at(1).startsWith('!') == false)
-                    block.active.insert(words.at(1), true);
+                if (words.size() > 1 and words.at(1).startsWith('!') == false)
+                    block.active.insert(QString::fromUtf8(words.at(1)), true);
             } else if (words.at(0) == "#if") {
                 // #if defined(STH)
             } else if (words.at(0) == "#else") {
@@ -141,25 +280,40 @@ bool FileParser::parse()
 
         //qDebug() << "Blocks: Active:" << block.active << "### Defined:" << block.defined;
 
-        const bool canRead = canReadIncludes(block);
-
         // TODO: add comment and scope detection
         if (line.startsWith("#include")) {
             if (line.contains('<')) {
-                // Library include - skip it
+                // Library include - do not parse it, only remember it
+                if (canReadIncludes(block)) {
+                    const int begin = line.indexOf('<') + 1;
+                    const int end = line.indexOf('>', begin);
+                    if (end > begin) {
+                        result.events.append(ParseResult::Event {
+                            ParseResult::LibraryInclude,
+                            QString::fromUtf8(line.constData() + begin, end - begin)
+                        });
+                    }
+                }
             } else if (line.contains('"')) {
-                if (canRead) {
+                if (canReadIncludes(block)) {
                     // Local include - parse it!
-                    QString include(line.mid(line.indexOf('"') + 1));
-                    include.chop(1);
-
-                    emit parseRequest(include, false);
+                    const int begin = line.indexOf('"') + 1;
+                    int length = line.indexOf('"', begin) - begin;
+                    if (length < 0)
+                        length = line.size() - begin;
+
+                    result.events.append(ParseResult::Event {
+                        ParseResult::Include,
+                        QString::fromUtf8(line.constData() + begin, length)
+                    });
                 }
             }
         }
 
         if (line.startsWith("Q_OBJECT") or line.startsWith("Q_GADGET")) {
-            emit runMoc(mFile);
+            result.events.append(ParseResult::Event {
+                ParseResult::Moc, QString()
+            });
         }
 
         // Detect GIBS comment scope
@@ -169,65 +323,134 @@ bool FileParser::parse()
             block.isComment = false;
 
         // Handle GIBS comments (commands)
-        if (line.startsWith(Tags::scopeOneLine + " ") or block.isComment) {
+        if (block.isComment or (startsWith(line, Tags::scopeOneLine)
+                                and line.size() > Tags::scopeOneLine.size()
+                                and line.at(Tags::scopeOneLine.size()) == ' '))
+        {
+            const QString command(QString::fromUtf8(line));
+
+            // Following ifdefs already see a feature declared here
+            const Gibs::Feature declared(extractFeature(command));
+            if (!declared.name.isEmpty() and !block.defined.contains(declared.define)) {
+                block.defined.insert(declared.define,
+                                     features.contains(declared.name)?
+                                         features.value(declared.name).enabled
+                                       : declared.enabled);
+            }
+
             // Override default source file location or name
-            if (line.contains(Tags::source))
-                source = extractArguments(line, Tags::source);
+            if (command.contains(Tags::source))
+                result.source = extractArguments(command, Tags::source);
 
-            parseCommand(line);
+            result.events.append(ParseResult::Event {
+                ParseResult::Command, command
+            });
         }
     }
 
-    const QFileInfo header(mFile);
-    if (source.isEmpty() and (header.suffix() == "cpp" or header.suffix() == "c"
-                              or header.suffix() == "cc"))
+    if (result.source.isEmpty() and (header.suffix() == "cpp"
+                                     or header.suffix() == "c"
+                                     or header.suffix() == "cc"))
     {
-        source = mFile;
+        result.source = file;
     }
 
-    // Guess source file name (.cpp)
-    if (source.isEmpty()) {
+    // Guess source file name (.cpp). Include paths are searched later, in
+    // apply(), because commands from this file can still modify them
+    if (result.source.isEmpty()) {
         if (header.suffix() == "h" or header.suffix() == "hpp") {
             const QString base(header.path() + "/" + header.baseName());
-            QString ext(findFileExtension(base));
-
-            // Search through include paths
-            if (ext.isEmpty()) {
-                const auto includePaths = mScope->includePaths();
-                for (const QString &inc : includePaths) {
-                    const QString incBase(inc + "/" + header.baseName());
-                    ext = findFileExtension(incBase);
-                    if (!ext.isEmpty()) {
-                        qDebug() << "Found source file in include paths!" << source;
-                        source = incBase + ext;
-                        break;
-                    }
+            const QString ext(findFileExtension(base, fileIndex));
+            if (!ext.isEmpty()) {
+                result.source = base + ext;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*!
+ * Acts upon scan \a result: replays includes, gibs commands and MOC requests
+ * in the order in which they were found, then emits parsed(). Returns false
+ * if the file could not be scanned.
+ *
+ * This method has to be called from the thread in which Scope lives.
+ */
+bool FileParser::apply(const ParseResult &result)
+{
+    if (!result.error.isEmpty()) {
+        emit error(result.error);
+        return false;
+    }
+
+    for (const auto &event : result.events) {
+        switch (event.type) {
+        case ParseResult::Include:
+            emit parseRequest(event.value, false);
+            break;
+        case ParseResult::Command:
+            parseCommand(event.value);
+            break;
+        case ParseResult::Moc:
+            emit runMoc(result.file);
+            break;
+        case ParseResult::LibraryInclude:
+        case ParseResult::Define:
+            // Used only by Scope, to choose precompiled headers
+            break;
+        }
+    }
+
+    QString source(result.source);
+    const QFileInfo header(result.file);
+
+    // Search through include paths
+    if (source.isEmpty()) {
+        if (header.suffix() == "h" or header.suffix() == "hpp") {
+            const auto includePaths = mScope->includePaths();
+            for (const QString &inc : includePaths) {
+                const QString incBase(inc + "/" + header.baseName());
+                const QString ext(findFileExtension(incBase, mScope->fileIndex()));
+                if (!ext.isEmpty()) {
+                    source = incBase + ext;
+                    qDebug() << "Found source file in include paths!" << source;
+                    break;
                 }
-            } else {
-                source = base + ext;
             }
         }
     }
 
     // Important: this emit needs to be sent before parseRequest()
-    if (QFileInfo::exists(source)) {
-        emit parsed(mFile, source, checksum.result(),
-                    header.lastModified(), header.created(),
-                    rawContents);
+    if (mScope->fileExists(source)) {
+        emit parsed(result.file, source, result.checksum,
+                    result.modified, result.created,
+                    result.contents);
     } else {
-        emit parsed(mFile, QString(), checksum.result(),
-                    header.lastModified(), header.created(),
-                    rawContents);
+        emit parsed(result.file, QString(), result.checksum,
+                    result.modified, result.created,
+                    result.contents);
     }
 
     // Parse source file, only when we are not parsing it already
-    if (!source.isEmpty() and source != mFile) {
+    if (!source.isEmpty() and source != result.file) {
         emit parseRequest(source, true);
     }
 
     return true;
 }
 
+/*!
+ * Scans \a file using settings stored in this FileScanner.
+ *
+ * \sa FileParser::scan
+ */
+ParseResult FileScanner::operator()(const QString &file) const
+{
+    return FileParser::scan(file, parseWholeFiles, features, cached.value(file),
+                            fileIndex.data());
+}
+
 /*!
  * Tries to find a suitable source file for header given in \a filePath and
  * returns its path.
@@ -235,20 +458,30 @@ bool FileParser::parse()
  * \todo rename this method to reflect the fact that it is finding a different
  * file than the one provided.
  */
-QString FileParser::findFileExtension(const QString &filePath) const
+QString FileParser::findFileExtension(const QString &filePath,
+                                      const FileIndex *fileIndex)
 {
-    if (QFileInfo::exists(filePath + ".cpp")) return ".cpp";
-    if (QFileInfo::exists(filePath + ".c")) return ".c";
-    if (QFileInfo::exists(filePath + ".cc")) return ".cc";
+    const auto exists = [fileIndex](const QString &path) {
+        return (fileIndex == nullptr)? QFileInfo::exists(path)
+                                     : fileIndex->exists(path);
+    };
+
+    if (exists(filePath + ".cpp")) return ".cpp";
+    if (exists(filePath + ".c")) return ".c";
+    if (exists(filePath + ".cc")) return ".cc";
     return QString();
 }
 
 /*!
  * Returns true if \a line opens a gibs comment block.
  */
-bool FileParser::scopeBegins(const QString &line) const
+bool FileParser::scopeBegins(const QByteArray &line)
 {
-    return (line == Tags::scopeBegin or line.startsWith(Tags::scopeBegin + " "));
+    if (!startsWith(line, Tags::scopeBegin))
+        return false;
+
+    return (line.size() == Tags::scopeBegin.size()
+            or line.at(Tags::scopeBegin.size()) == ' ');
 }
 
 /*!
@@ -256,15 +489,16 @@ bool FileParser::scopeBegins(const QString &line) const
  * is used to determine whether current \a line is active or disabled (behind
  * an ifdef).
  */
-bool FileParser::scopeEnds(const QString &line, const ParseBlock &block) const
+bool FileParser::scopeEnds(const QByteArray &line, const ParseBlock &block)
 {
-    return (block.isComment and line.contains(Tags::scopeEnd));
+    return (block.isComment and line.contains(QByteArray::fromRawData(
+                Tags::scopeEnd.data(), Tags::scopeEnd.size())));
 }
 
 /*!
  * Returns true if ifdefs set in current \a block allow includes to be read.
  */
-bool FileParser::canReadIncludes(const ParseBlock &block) const
+bool FileParser::canReadIncludes(const ParseBlock &block)
 {
     const QList<QString> activeKeys(block.active.keys(true));
     for (const QString &key : activeKeys) {
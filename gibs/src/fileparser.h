@@ -1,7 +1,9 @@
 #pragma once
 
 #include "baseparser.h"
+#include "parseresult.h"
 #include "tags.h"
+#include "fileindex.h"
 
 #include <QByteArray>
 #include <QString>
@@ -51,6 +53,22 @@ struct ParseBlock {
     ;
 };
 
+/*!
+ * \brief The FileScanner struct wraps FileParser::scan() in a function object
+ * which can be used with QtConcurrent::mapped().
+ */
+struct FileScanner {
+    typedef ParseResult result_type;
+
+    ParseResult operator()(const QString &file) const;
+
+    bool parseWholeFiles = false;
+    QHash<QString, Gibs::Feature> features;
+    //! Results of previous scans, by file path
+    QHash<QString, ParseResult> cached;
+    FileIndexPtr fileIndex;
+};
+
 /*!
  * \brief The FileParser class reads C++ source code, extracting from it the
  * information necessary to build it.
@@ -64,6 +82,12 @@ public:
                         Scope *scope,
                         QObject *parent = nullptr);
 
+    static ParseResult scan(const QString &file, const bool parseWholeFiles,
+                            const QHash<QString, Gibs::Feature> &features,
+                            const ParseResult &cached = ParseResult(),
+                            const FileIndex *fileIndex = nullptr);
+    bool apply(const ParseResult &result);
+
 signals:
     void parsed(const QString &file,
                 const QString &sourceFile,
@@ -79,10 +103,11 @@ public slots:
     bool parse() override final;
 
 protected:
-    QString findFileExtension(const QString &filePath) const;
-    bool scopeBegins(const QString &line) const;
-    bool scopeEnds(const QString &line, const ParseBlock &block) const;
-    bool canReadIncludes(const ParseBlock &block) const;
+    static QString findFileExtension(const QString &filePath,
+                                     const FileIndex *fileIndex = nullptr);
+    static bool scopeBegins(const QByteArray &line);
+    static bool scopeEnds(const QByteArray &line, const ParseBlock &block);
+    static bool canReadIncludes(const ParseBlock &block);
 
     const QString mFile;
     const bool mParseWholeFiles;
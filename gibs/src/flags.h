@@ -243,6 +243,18 @@ public:
     // Compilation
     QString compilerName = "gcc";
 
+    // Object cache. Size is in MiB, 0 disables the cache. cacheDir is
+    // a shared cache, used in addition to local one
+    QString cacheDir;
+    // Build precompiled header from most commonly included library headers
+    bool autoPch = true;
+    // Compile sources in unity batches. 0 batches means one batch per job
+    bool unity = false;
+    int unityBatches = 0;
+    // Compile several small sources with one compiler call
+    bool multiCompile = false;
+    qint64 cacheSize = 5 * 1024;
+
     // Cross compilation
     bool crossCompile = false;
     QString sysroot; ///media/sierdzio/data/android/ndk-r15/sysroot
@@ -6,6 +6,10 @@
 
 #include <QDebug>
 
+#if defined(Q_OS_UNIX)
+#include <sys/stat.h>
+#endif
+
 void Gibs::removeFile(const QString &path) {
     if (QFile::exists(path)) {
         qInfo() << "Removing:" << path;
@@ -13,6 +17,97 @@ void Gibs::removeFile(const QString &path) {
     }
 }
 
+/*!
+ * Returns inode, size and modification time of file at \a path. This is
+ * a single stat() call on Unix.
+ */
+Gibs::FileStat Gibs::fileStat(const QString &path)
+{
+    FileStat result;
+#if defined(Q_OS_UNIX)
+    struct stat info;
+    if (::stat(QFile::encodeName(path).constData(), &info) != 0)
+        return result;
+
+    result.inode = quint64(info.st_ino);
+    result.size = qint64(info.st_size);
+#if defined(Q_OS_DARWIN)
+    result.modified = qint64(info.st_mtimespec.tv_sec) * 1000000000
+            + info.st_mtimespec.tv_nsec;
+#else
+    result.modified = qint64(info.st_mtim.tv_sec) * 1000000000
+            + info.st_mtim.tv_nsec;
+#endif
+#else
+    const QFileInfo info(path);
+    if (!info.exists())
+        return result;
+
+    result.size = info.size();
+    result.modified = info.lastModified().toMSecsSinceEpoch() * 1000000;
+#endif
+    return result;
+}
+
+/*!
+ * Reads Makefile-style dependency file at \a path (as written by the compiler
+ * with -MMD -MF) and returns all prerequisites of the first target. They
+ * include the compiled source itself, except when it was read from standard
+ * input ("-" is left out).
+ *
+ * Returns an empty list if the file cannot be read.
+ */
+QStringList Gibs::readDepfile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return QStringList();
+
+    const QByteArray data(file.readAll());
+    QStringList result;
+    QByteArray current;
+    bool isTarget = true;
+
+    for (int i = 0; i < data.size(); ++i) {
+        const char character = data.at(i);
+        if (character == '\\' and i + 1 < data.size()) {
+            const char next = data.at(i + 1);
+            if (next == '\n') {
+                // Line continuation
+                ++i;
+                continue;
+            } else if (next == ' ' or next == '#') {
+                current.append(next);
+                ++i;
+                continue;
+            }
+        }
+
+        if (character == ' ' or character == '\t' or character == '\n') {
+            if (!current.isEmpty()) {
+                if (isTarget and current.endsWith(':')) {
+                    isTarget = false;
+                } else if (!isTarget and current != "-") {
+                    result.append(QFile::decodeName(current));
+                }
+                current.clear();
+            }
+
+            // Only first rule is interesting
+            if (character == '\n' and !isTarget)
+                break;
+            continue;
+        }
+
+        current.append(character);
+    }
+
+    if (!current.isEmpty() and !isTarget and current != "-")
+        result.append(QFile::decodeName(current));
+
+    return result;
+}
+
 QString Gibs::findFile(const QString &directory, const QString &name)
 {
     const QDir dir(directory);
@@ -19,12 +19,32 @@ struct Feature {
     bool enabled = false;
 };
 
+/*!
+ * File metadata used for quick change detection, like in make or git index.
+ * Modification time is in nanoseconds since epoch, where the platform
+ * supports it. Size is -1 if the file could not be found.
+ */
+struct FileStat {
+    quint64 inode = 0;
+    qint64 size = -1;
+    qint64 modified = 0;
+
+    bool isValid() const { return size >= 0; }
+    bool operator==(const FileStat &other) const {
+        return inode == other.inode and size == other.size
+                and modified == other.modified;
+    }
+    bool operator!=(const FileStat &other) const { return !(*this == other); }
+};
+
 enum ToolType {
     Compiler,
     Deployer
 };
 
 void removeFile(const QString &path);
+FileStat fileStat(const QString &path);
+QStringList readDepfile(const QString &path);
 QString findFile(const QString &directory, const QString &name);
 QString findJsonToolDefinition(const QString &tool, const ToolType type);
 QJsonDocument readJsonFile(const QString &path);
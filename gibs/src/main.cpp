@@ -118,6 +118,29 @@ int main(int argc, char *argv[]) {
         QCoreApplication::translate(scope, "Automatically scan source directory for include paths. This can be used instead of gibs command 'include some/path' if the path is below input file.")},
         {Tags::pipe_flag,
         QCoreApplication::translate(scope, "Pipe C/C++ code read by gibs into compiler. This prevents files from being read twice.")},
+        {Tags::cache_size_flag,
+        QCoreApplication::translate(scope, "Maximum size of object cache, in MiB. Least recently used objects are removed when the cache grows above it. 0 turns object cache off. Default: 5120"),
+        QCoreApplication::translate(scope, "MiB"),
+        "5120"},
+        {Tags::cache_dir_flag,
+        QCoreApplication::translate(scope, "Shared object cache directory (for example a network mount used by the whole team, or by CI). Objects missing in local cache are taken from there, new objects are published there. It is trimmed only if its 'size-limit' file holds a size in MiB"),
+        QCoreApplication::translate(scope, "path")},
+        {Tags::no_pch_flag,
+        QCoreApplication::translate(scope, "Do not build precompiled headers. By default, gibs precompiles library headers (Qt, STL) included by at least half of the source files")},
+        {Tags::unity_flag,
+        QCoreApplication::translate(scope, "Unity build: compile sources in generated batches, balanced by compile time from previous builds or by file size. Sources with '//i unity off' are compiled separately")},
+        {Tags::unity_batches_flag,
+        QCoreApplication::translate(scope, "Number of unity batches, implies --unity. Default: one batch per job"),
+        QCoreApplication::translate(scope, "N"),
+        "0"},
+        {Tags::multi_compile_flag,
+        QCoreApplication::translate(scope, "Compile sources which took less than 100 ms in previous builds several at a time, with one compiler call, to save on process startup. Does not work with --pipe")},
+        {Tags::export_cache_flag,
+        QCoreApplication::translate(scope, "Pack gibs cache and all up to date objects of this project into a bundle file, then quit. Build the project first"),
+        QCoreApplication::translate(scope, "bundle")},
+        {Tags::import_cache_flag,
+        QCoreApplication::translate(scope, "Seed object cache (and gibs cache, if there is none yet) from a bundle made with --export-cache, then build"),
+        QCoreApplication::translate(scope, "bundle")},
         {{"j", Tags::jobs},
         QCoreApplication::translate(scope, "Max number of threads used to compile and process the sources. If not specified, gibs will use max possible number of threads. If a fraction is specified, it will use given percentage of available cores (-j 0.5 means half of all CPU cores)"),
         QCoreApplication::translate(scope, "threads"),
@@ -188,6 +211,15 @@ int main(int argc, char *argv[]) {
     flags.setPipe(parser.isSet(Tags::pipe_flag));
 
     flags.setJobs(parser.value(Tags::jobs).toFloat(&jobsOk));
+    bool cacheSizeOk = false;
+    flags.cacheSize = parser.value(Tags::cache_size_flag).toLongLong(&cacheSizeOk);
+    flags.cacheDir = parser.value(Tags::cache_dir_flag);
+    flags.autoPch = !parser.isSet(Tags::no_pch_flag);
+    flags.unity = parser.isSet(Tags::unity_flag)
+            or parser.isSet(Tags::unity_batches_flag);
+    flags.multiCompile = parser.isSet(Tags::multi_compile_flag);
+    bool unityOk = false;
+    flags.unityBatches = parser.value(Tags::unity_batches_flag).toInt(&unityOk);
     flags.qtDir = Gibs::ifEmpty(parser.value(Tags::qt_dir_flag), flags.qtDir);
     flags.commands = Gibs::ifEmpty(parser.value(Tags::commands), flags.commands);
     flags.deployerName = Gibs::ifEmpty(parser.value(Tags::deployer_tool),
@@ -221,6 +253,16 @@ int main(int argc, char *argv[]) {
     }
     flags.setRelativePath(flags.inputFile);
 
+    if (!cacheSizeOk or flags.cacheSize < 0) {
+        qFatal("Invalid object cache size specified. Use '--cache-size MiB'. Got: %s",
+               qPrintable(parser.value(Tags::cache_size_flag)));
+    }
+
+    if (!unityOk or flags.unityBatches < 0) {
+        qFatal("Invalid number of unity batches specified. Use '--unity-batches N'. Got: %s",
+               qPrintable(parser.value(Tags::unity_batches_flag)));
+    }
+
     if (!jobsOk) {
         qFatal("Invalid number of jobs specified. Use '-j NUM'. Got: %s",
                qPrintable(parser.value(Tags::jobs)));
@@ -242,6 +284,10 @@ int main(int argc, char *argv[]) {
     }
 
     ProjectManager manager(flags);
+    if (parser.isSet(Tags::import_cache_flag)) {
+        manager.importCache(parser.value(Tags::import_cache_flag));
+    }
+
     manager.loadCache();
     manager.loadCommands();
     manager.loadFeatures(features);
@@ -251,7 +297,10 @@ int main(int argc, char *argv[]) {
                      &app, &QCoreApplication::exit);
 
     int result = 1;
-    if (flags.clean) {
+    if (parser.isSet(Tags::export_cache_flag)) {
+        result = manager.exportCache(parser.value(Tags::export_cache_flag))? 0 : 1;
+        qInfo() << "Exporting cache took:" << timer.elapsed() << "ms";
+    } else if (flags.clean) {
         QTimer::singleShot(1, &manager, &ProjectManager::clean);
         result = app.exec();
         qInfo() << "Cleaning took:" << timer.elapsed() << "ms";
@@ -7,18 +7,40 @@ MetaProcess::MetaProcess()
 {
 }
 
-bool MetaProcess::canRun() const
+/*!
+ * Makes this process wait for \a dependency, also when it has already been
+ * scheduled.
+ */
+void MetaProcess::addDependency(const MetaProcessPtr &dependency)
 {
-    if (process.isNull()) {
-        return false;
+    fileDependencies.append(dependency);
+    if (isScheduled and !dependency->hasFinished) {
+        ++pendingDependencies;
+        dependency->dependents.append(sharedFromThis());
     }
+}
+
+/*!
+ * Returns how long the process is expected to run, in ms: as long as in the
+ * last build, or a rough guess based on process type if it has not run before.
+ */
+qint64 MetaProcess::estimatedDuration() const
+{
+    if (expectedDuration >= 0)
+        return expectedDuration;
 
-    for (const auto &metaprocess : qAsConst(fileDependencies)) {
-        if (metaprocess->hasFinished == false) {
-            qDebug() << "Waiting for:" << metaprocess->process->arguments().last();
-            return false;
-        }
+    switch (type) {
+    case Generate:
+        return 200;
+    case Compile:
+        return 1000;
+    case Archive:
+        return 500;
+    case Link:
+        return 2000;
+    case Deploy:
+        return 5000;
     }
 
-    return true;
+    return 1000;
 }
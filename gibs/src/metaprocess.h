@@ -2,7 +2,9 @@
 
 #include <QString>
 #include <QVector>
+#include <QStringList>
 #include <QSharedPointer>
+#include <QElapsedTimer>
 
 class QProcess;
 class MetaProcess;
@@ -10,16 +12,50 @@ class MetaProcess;
 using ProcessPtr = QSharedPointer<QProcess>;
 using MetaProcessPtr = QSharedPointer<MetaProcess>;
 
-class MetaProcess
+/*!
+ * \brief The MetaProcess class is a node of the build graph: a single process
+ * (compilation, linking etc.) together with processes it waits for.
+ *
+ * ProjectManager counts how many of fileDependencies have not finished yet.
+ * When the last of them finishes, it unblocks this process through its
+ * dependents list, so no process has to be checked more than once.
+ * Processes which wait for whole scopes (scopeDepenencies) are counted in the
+ * same way, they are unblocked when Scope::finished() is emitted.
+ */
+class MetaProcess : public QEnableSharedFromThis<MetaProcess>
 {
 public:
+    enum Type {
+        Generate,
+        Compile,
+        Archive,
+        Link,
+        Deploy
+    };
+
     MetaProcess();
 
-    bool canRun() const;
+    void addDependency(const MetaProcessPtr &dependency);
+    qint64 estimatedDuration() const;
 
+    Type type = Compile;
     bool hasFinished = false;
+    bool canFail = false; //! If true, failure is reported with ProjectManager::processFailed instead of stopping the build
+    bool hasFailed = false;
+    QElapsedTimer timer; //! Started when process starts
+    qint64 startTime = -1; //! When process has started, in ns since epoch (like Gibs::FileStat::modified). -1 if it has not
+    qint64 duration = -1; //! How long the process has run, in ms
+    qint64 expectedDuration = -1; //! How long the process took in last build, in ms. -1 if not known
+    qint64 priority = 0; //! Expected time from start of this process to the end of the build, in ms
+    quint64 readyOrder = 0; //! When process became ready to run, among those with the same priority
     QString file; //! Target file (which will be compiled, linked etc.)
+    QStringList outputs; //! All target files, if process produces more than one. First one is file
     ProcessPtr process; //! QProcess pointer
     QVector<MetaProcessPtr> fileDependencies; //! List of processes which need to end before this one starts
+    bool isScheduled = false; //! Set when ProjectManager has added the process to the build graph
+    bool isReady = false; //! Set while the process is in ProjectManager's ready queue
+    int pendingDependencies = 0; //! Number of fileDependencies and scopeDepenencies which have not finished yet
+    QVector<QWeakPointer<MetaProcess>> dependents; //! Scheduled processes waiting for this one
     QVector<QByteArray> scopeDepenencies; //! List of other scopes which this process depends on
+    QByteArray scopeId; //! Scope which has created this process
 };
@@ -0,0 +1,577 @@
+#include "objectcache.h"
+#include "checksum.h"
+#include "gibs.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QProcess>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#include <algorithm>
+
+#include <QDebug>
+
+namespace {
+// Older entries are dropped from a manifest
+const int maxManifestEntries = 16;
+const QLatin1String objectTag("object");
+const QLatin1String dependenciesTag("dependencies");
+// Size limit of a shared cache, in MiB, is read from this file
+const QLatin1String sizeLimitFile("size-limit");
+
+// Returns what \a compiler prints for \a arguments, or nothing if it fails
+QByteArray compilerOutput(const QString &compiler, const QStringList &arguments)
+{
+    QProcess process;
+    process.start(compiler, arguments);
+    if (!process.waitForFinished() or process.exitStatus() != QProcess::NormalExit
+            or process.exitCode() != 0) {
+        return QByteArray();
+    }
+    return process.readAllStandardOutput().trimmed();
+}
+}
+
+/*!
+ * Creates object cache in \a directory. Cache will be trimmed down to
+ * \a maxSize bytes. If \a maxSize is 0 or \a directory is empty, the cache is
+ * disabled.
+ */
+ObjectCache::ObjectCache(const QString &directory, const qint64 maxSize)
+    : mDirectory(directory), mMaxSize(maxSize)
+{
+}
+
+/*!
+ * Returns size limit (in bytes) stored in \a directory of a shared cache, or 0
+ * if there is none. The limit is set by whoever maintains the shared cache:
+ * gibs clients must not trim it down to their local cache size.
+ */
+qint64 ObjectCache::storedSizeLimit(const QString &directory)
+{
+    QFile file(directory + "/" + sizeLimitFile);
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return 0;
+
+    bool isOk = false;
+    const qint64 megabytes = file.readAll().trimmed().toLongLong(&isOk);
+    return (isOk and megabytes > 0)? megabytes * 1024 * 1024 : 0;
+}
+
+bool ObjectCache::isEnabled() const
+{
+    return (mMaxSize > 0 and !mDirectory.isEmpty());
+}
+
+QString ObjectCache::directory() const
+{
+    return mDirectory;
+}
+
+/*!
+ * Sets \a shared cache, used when an object is not found in this one.
+ */
+void ObjectCache::setShared(const ObjectCachePtr &shared)
+{
+    mShared = shared;
+}
+
+/*!
+ * Makes the cache treat \a path as a location which can be different in each
+ * checkout. It is replaced with a placeholder made from \a name wherever it
+ * appears in compiler arguments and dependency lists. Setting the same
+ * \a name again replaces the previous path.
+ */
+void ObjectCache::setPathPrefix(const QString &name, const QString &path)
+{
+    if (!mShared.isNull())
+        mShared->setPathPrefix(name, path);
+
+    const QString placeholder("@" + name + "@");
+    for (int i = mPrefixes.size() - 1; i >= 0; --i) {
+        if (mPrefixes.at(i).placeholder == placeholder)
+            mPrefixes.removeAt(i);
+    }
+
+    const QString cleanPath(QDir::cleanPath(QDir(path).absolutePath()));
+    // Replacing root directory would break every path
+    if (path.isEmpty() or QDir(cleanPath).isRoot())
+        return;
+
+    // Compiled once, keys are computed for every compilation
+    QRegularExpression expression(QRegularExpression::escape(cleanPath)
+                                  + QStringLiteral("(?=[/=:\\s]|$)"),
+                                  QRegularExpression::MultilineOption);
+    expression.optimize();
+    mPrefixes.append(Prefix { placeholder, cleanPath, expression });
+    std::sort(mPrefixes.begin(), mPrefixes.end(),
+              [](const Prefix &left, const Prefix &right) {
+        return left.path.size() > right.path.size();
+    });
+}
+
+/*!
+ * Returns the lookup key for compilation of source file with
+ * \a sourceChecksum, using \a compiler with \a arguments.
+ */
+QByteArray ObjectCache::key(const QString &compiler,
+                            const QStringList &arguments,
+                            const QByteArray &sourceChecksum)
+{
+    QByteArray data(Checksum::algorithm().latin1());
+    data.append('\n');
+    data.append(compilerIdentity(compiler));
+    data.append('\n');
+    data.append(normalized(arguments.join('\n')).toUtf8());
+    data.append('\n');
+    data.append(sourceChecksum);
+    return Checksum::hash(data.constData(), data.size());
+}
+
+/*!
+ * Looks for an object compiled with \a key whose dependencies have not
+ * changed, first in this cache, then in the shared one. If found, it is
+ * copied to \a objectFile and its depfile to \a depfile, and true is
+ * returned.
+ */
+bool ObjectCache::restore(const QByteArray &key, const QString &objectFile,
+                          const QString &depfile)
+{
+    if (find(key, objectFile, depfile)) {
+        ++mHits;
+        return true;
+    }
+
+    if (!mShared.isNull() and mShared->find(key, objectFile, depfile)) {
+        // Read-through: next time it will be found locally
+        store(key, objectFile, depfile, false);
+        ++mHits;
+        return true;
+    }
+
+    ++mMisses;
+    return false;
+}
+
+bool ObjectCache::find(const QByteArray &key, const QString &objectFile,
+                       const QString &depfile)
+{
+    const QVector<QByteArray> objectKeys(matchingObjects(key));
+    for (const QByteArray &objectKey : objectKeys) {
+        const QString cachedObject(objectPath(objectKey, ".o"));
+        const QString cachedDepfile(objectPath(objectKey, ".d"));
+
+        // Depfile paths point to this checkout again
+        QFile cachedDependencies(cachedDepfile);
+        if (!cachedDependencies.open(QFile::ReadOnly))
+            continue;
+        const QByteArray dependencyData(
+                    expanded(QString::fromUtf8(cachedDependencies.readAll())).toUtf8());
+
+        QFile::remove(objectFile);
+        if (!QFile::copy(cachedObject, objectFile)
+                or !writeFile(depfile, dependencyData)) {
+            qWarning() << "Could not restore object from cache:" << objectFile;
+            continue;
+        }
+
+        // Mark as recently used
+        for (const QString &path : { cachedObject, cachedDepfile, manifestPath(key) }) {
+            QFile cached(path);
+            if (cached.open(QFile::ReadWrite)) {
+                cached.setFileTime(QDateTime::currentDateTime(),
+                                   QFileDevice::FileModificationTime);
+            }
+        }
+
+        qInfo() << "Restored from object cache:" << objectFile
+                << "(" << mDirectory << ")";
+        return true;
+    }
+
+    return false;
+}
+
+/*!
+ * Returns keys of objects listed in manifest of \a key, whose dependencies
+ * have not changed and which are still present in cache. Newest come first.
+ */
+QVector<QByteArray> ObjectCache::matchingObjects(const QByteArray &key)
+{
+    QVector<QByteArray> result;
+    QFile manifest(manifestPath(key));
+    if (!manifest.open(QFile::ReadOnly))
+        return result;
+
+    const QJsonArray entries(QJsonDocument::fromJson(manifest.readAll()).array());
+    for (const auto &entryValue : entries) {
+        const QJsonObject entry(entryValue.toObject());
+        const QJsonObject dependencies(entry.value(dependenciesTag).toObject());
+
+        bool isMatching = true;
+        for (auto it = dependencies.constBegin(); it != dependencies.constEnd(); ++it) {
+            if (fileChecksum(expanded(it.key())).toHex() != it.value().toString().toLatin1()) {
+                isMatching = false;
+                break;
+            }
+        }
+
+        if (!isMatching)
+            continue;
+
+        const QByteArray objectKey(QByteArray::fromHex(
+                                       entry.value(objectTag).toString().toLatin1()));
+        if (QFile::exists(objectPath(objectKey, ".o"))
+                and QFile::exists(objectPath(objectKey, ".d"))) {
+            result.append(objectKey);
+        }
+    }
+
+    return result;
+}
+
+/*!
+ * Stores \a objectFile and its \a depfile in cache, under \a key. Checksums of
+ * all dependencies listed in \a depfile are saved, too. Call
+ * forgetChecksums() before storing objects, generated headers can change
+ * after they have been checked in restore().
+ *
+ * If \a isShared is true, the object is published in shared cache as well.
+ */
+void ObjectCache::store(const QByteArray &key, const QString &objectFile,
+                        const QString &depfile, const bool isShared)
+{
+    if (isShared and !mShared.isNull())
+        mShared->store(key, objectFile, depfile, false);
+
+    QFile object(objectFile);
+    QFile dependencyFile(depfile);
+    if (!object.open(QFile::ReadOnly) or !dependencyFile.open(QFile::ReadOnly))
+        return;
+
+    QStringList dependencies(Gibs::readDepfile(depfile));
+    dependencies.sort();
+
+    QJsonObject dependencyChecksums;
+    QByteArray objectKeyData(key);
+    for (const QString &dependency : qAsConst(dependencies)) {
+        const QByteArray checksum(fileChecksum(dependency));
+        if (checksum.isEmpty())
+            return;
+        const QString normalizedDependency(normalized(dependency));
+        dependencyChecksums.insert(normalizedDependency, QString(checksum.toHex()));
+        objectKeyData.append(normalizedDependency.toUtf8());
+        objectKeyData.append(checksum);
+    }
+
+    const QByteArray objectKey(Checksum::hash(objectKeyData.constData(),
+                                              objectKeyData.size()));
+    if (!writeFile(objectPath(objectKey, ".o"), object.readAll())
+            or !writeFile(objectPath(objectKey, ".d"),
+                          normalized(QString::fromUtf8(dependencyFile.readAll())).toUtf8())) {
+        qWarning() << "Could not store object in cache:" << objectFile;
+        return;
+    }
+
+    // Other gibs processes may update this manifest at the same time. Writes
+    // are atomic, so at worst one of the new entries is lost, which only
+    // costs a cache miss later
+    QJsonArray entries;
+    {
+        QFile manifest(manifestPath(key));
+        if (manifest.open(QFile::ReadOnly))
+            entries = QJsonDocument::fromJson(manifest.readAll()).array();
+    }
+
+    const QString objectKeyHex(objectKey.toHex());
+    for (int i = entries.size() - 1; i >= 0; --i) {
+        if (entries.at(i).toObject().value(objectTag).toString() == objectKeyHex)
+            entries.removeAt(i);
+    }
+
+    QJsonObject entry;
+    entry.insert(objectTag, objectKeyHex);
+    entry.insert(dependenciesTag, dependencyChecksums);
+    entries.prepend(entry);
+    while (entries.size() > maxManifestEntries)
+        entries.removeLast();
+
+    writeFile(manifestPath(key), QJsonDocument(entries).toJson(QJsonDocument::Compact));
+    mHasStored = true;
+}
+
+/*!
+ * Drops remembered checksums of files. They are computed again when they are
+ * needed next time.
+ */
+void ObjectCache::forgetChecksums()
+{
+    if (!mShared.isNull())
+        mShared->forgetChecksums();
+
+    mChecksums.clear();
+}
+
+/*!
+ * Removes least recently used objects and manifests until the cache (and
+ * shared cache) fits in its maximum size. Manifest entries pointing to
+ * removed objects are dropped, too. Does nothing if nothing was stored in
+ * this run, or if cache has no size limit (see storedSizeLimit()).
+ */
+void ObjectCache::trim()
+{
+    if (!mShared.isNull())
+        mShared->trim();
+
+    if (!mHasStored or mMaxSize <= 0)
+        return;
+
+    QVector<QFileInfo> files;
+    qint64 totalSize = 0;
+    for (const QString &subdir : { QString("/objects"), QString("/manifests") }) {
+        QDirIterator it(mDirectory + subdir, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            it.next();
+            files.append(it.fileInfo());
+            totalSize += it.fileInfo().size();
+        }
+    }
+
+    if (totalSize <= mMaxSize)
+        return;
+
+    std::sort(files.begin(), files.end(),
+              [](const QFileInfo &left, const QFileInfo &right) {
+        return left.lastModified() < right.lastModified();
+    });
+
+    for (const QFileInfo &file : qAsConst(files)) {
+        if (totalSize <= mMaxSize)
+            break;
+
+        if (QFile::remove(file.filePath()))
+            totalSize -= file.size();
+    }
+
+    totalSize -= pruneManifests();
+    qInfo() << "Object cache trimmed to:" << totalSize << "bytes";
+}
+
+/*!
+ * Removes manifest entries whose objects are no longer in cache, and
+ * manifests which have no entries left. Returns number of bytes freed.
+ */
+qint64 ObjectCache::pruneManifests()
+{
+    qint64 freed = 0;
+    QDirIterator it(mDirectory + "/manifests", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path(it.next());
+        const qint64 size = it.fileInfo().size();
+
+        QJsonArray entries;
+        {
+            QFile manifest(path);
+            if (!manifest.open(QFile::ReadOnly))
+                continue;
+            entries = QJsonDocument::fromJson(manifest.readAll()).array();
+        }
+
+        const int count = entries.size();
+        for (int i = count - 1; i >= 0; --i) {
+            const QByteArray objectKey(QByteArray::fromHex(
+                entries.at(i).toObject().value(objectTag).toString().toLatin1()));
+            if (!QFile::exists(objectPath(objectKey, ".o")))
+                entries.removeAt(i);
+        }
+
+        if (entries.isEmpty()) {
+            if (QFile::remove(path))
+                freed += size;
+        } else if (entries.size() != count) {
+            const QByteArray data(QJsonDocument(entries).toJson(QJsonDocument::Compact));
+            if (writeFile(path, data))
+                freed += size - data.size();
+        }
+    }
+
+    return freed;
+}
+
+/*!
+ * Returns files (relative to cache directory) needed to restore the object
+ * compiled with \a key in another checkout: its manifest, object and depfile.
+ * Returns an empty list if there is no up to date object for \a key.
+ */
+QStringList ObjectCache::entryFiles(const QByteArray &key)
+{
+    const QVector<QByteArray> objectKeys(matchingObjects(key));
+    if (objectKeys.isEmpty())
+        return QStringList();
+
+    return {
+        relativePath(manifestPath(key)),
+        relativePath(objectPath(objectKeys.first(), ".o")),
+        relativePath(objectPath(objectKeys.first(), ".d"))
+    };
+}
+
+/*!
+ * Puts a file \a name (as returned by entryFiles()) with \a data into the
+ * cache. Objects already present are kept. Manifests are merged with local
+ * ones, local entries come first.
+ */
+bool ObjectCache::importFile(const QString &name, const QByteArray &data)
+{
+    const QStringList parts(name.split('/'));
+    if (parts.size() != 3 or parts.contains("..")
+            or (parts.first() != "objects" and parts.first() != "manifests")) {
+        qWarning() << "Unexpected file in cache bundle:" << name;
+        return false;
+    }
+
+    const QString path(mDirectory + "/" + name);
+    if (parts.first() == "objects") {
+        if (QFile::exists(path))
+            return true;
+        mHasStored = true;
+        return writeFile(path, data);
+    }
+
+    QJsonArray entries;
+    {
+        QFile manifest(path);
+        if (manifest.open(QFile::ReadOnly))
+            entries = QJsonDocument::fromJson(manifest.readAll()).array();
+    }
+
+    const QJsonArray imported(QJsonDocument::fromJson(data).array());
+    for (const auto &entry : imported) {
+        if (!entries.contains(entry) and entries.size() < maxManifestEntries)
+            entries.append(entry);
+    }
+
+    return writeFile(path, QJsonDocument(entries).toJson(QJsonDocument::Compact));
+}
+
+int ObjectCache::hits() const
+{
+    return mHits;
+}
+
+int ObjectCache::misses() const
+{
+    return mMisses;
+}
+
+/*!
+ * Returns a string which changes whenever \a compiler binary is replaced:
+ * its file name and checksum of its contents. Path and modification time are
+ * not used, so that caches can be moved between machines (see CacheBundle).
+ *
+ * Driver binary can be the same on machines with different compilers proper
+ * and standard libraries, so target, full version and checksum of cc1plus
+ * (if the compiler reports where it is) are added, too.
+ */
+QByteArray ObjectCache::compilerIdentity(const QString &compiler)
+{
+    auto it = mCompilers.constFind(compiler);
+    if (it != mCompilers.constEnd())
+        return it.value();
+
+    QString path(compiler);
+    if (!QFileInfo(path).isAbsolute())
+        path = QStandardPaths::findExecutable(compiler);
+
+    QByteArray identity(QFileInfo(path).fileName().toUtf8() + ":"
+                        + Checksum::fileHash(path).toHex());
+    if (!path.isEmpty()) {
+        identity.append(':');
+        identity.append(compilerOutput(path, { "-dumpmachine" }));
+        identity.append(':');
+        identity.append(compilerOutput(path, { "-dumpfullversion", "-dumpversion" }));
+        const QString compilerProper(QString::fromUtf8(
+            compilerOutput(path, { "-print-prog-name=cc1plus" })));
+        if (QFileInfo(compilerProper).isAbsolute()) {
+            identity.append(':');
+            identity.append(Checksum::fileHash(compilerProper).toHex());
+        }
+    }
+    mCompilers.insert(compiler, identity);
+    return identity;
+}
+
+QByteArray ObjectCache::fileChecksum(const QString &path)
+{
+    auto it = mChecksums.constFind(path);
+    if (it != mChecksums.constEnd())
+        return it.value();
+
+    // Missing files are not remembered, they can still be generated
+    const QByteArray checksum(Checksum::fileHash(path));
+    if (!checksum.isEmpty())
+        mChecksums.insert(path, checksum);
+    return checksum;
+}
+
+QString ObjectCache::relativePath(const QString &path) const
+{
+    return path.mid(mDirectory.size() + 1);
+}
+
+QString ObjectCache::manifestPath(const QByteArray &key) const
+{
+    const QString hex(key.toHex());
+    return mDirectory + "/manifests/" + hex.left(2) + "/" + hex;
+}
+
+QString ObjectCache::objectPath(const QByteArray &key, const QString &suffix) const
+{
+    const QString hex(key.toHex());
+    return mDirectory + "/objects/" + hex.left(2) + "/" + hex + suffix;
+}
+
+/*!
+ * Replaces path prefixes in \a text with their placeholders. A prefix is
+ * replaced only if it is a whole path or is followed by a path separator.
+ */
+QString ObjectCache::normalized(QString text) const
+{
+    for (const auto &prefix : qAsConst(mPrefixes))
+        text.replace(prefix.expression, prefix.placeholder);
+    return text;
+}
+
+/*!
+ * Replaces placeholders in \a text with path prefixes of this checkout.
+ */
+QString ObjectCache::expanded(QString text) const
+{
+    for (const auto &prefix : qAsConst(mPrefixes))
+        text.replace(prefix.placeholder, prefix.path);
+    return text;
+}
+
+/*!
+ * Writes \a data to \a path atomically: data goes to a temporary file first,
+ * which is then renamed. Readers see either the old file or the complete new
+ * one, also when other gibs processes write the same file.
+ */
+bool ObjectCache::writeFile(const QString &path, const QByteArray &data)
+{
+    QDir().mkpath(QFileInfo(path).path());
+
+    QSaveFile file(path);
+    if (!file.open(QFile::WriteOnly))
+        return false;
+
+    file.write(data);
+    return file.commit();
+}
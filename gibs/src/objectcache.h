@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QRegularExpression>
+#include <QSharedPointer>
+
+class ObjectCache;
+
+using ObjectCachePtr = QSharedPointer<ObjectCache>;
+
+/*!
+ * \brief The ObjectCache class stores compiled object files (with their
+ * depfiles), so that the same compilation does not have to be run again.
+ *
+ * Lookup is done in two steps. First, a key is computed from compiler
+ * identity, full list of compiler arguments and checksum of the source file.
+ * The key points to a manifest which lists objects compiled with that key,
+ * together with checksums of all headers they depended on. An object is
+ * restored only if all these headers still have the same contents.
+ *
+ * Paths which differ between checkouts (source root, Qt dir) are replaced with
+ * placeholders in keys, manifests and cached depfiles. Thanks to that, the same
+ * sources built in different directories share cache entries.
+ *
+ * Least recently used objects and manifests are removed when cache grows
+ * above its size limit.
+ *
+ * Object cache can have a shared cache behind it (for example on a network
+ * mount, used by the whole team). Objects not found locally are looked up in
+ * the shared cache and copied to the local one; new objects are stored in
+ * both. Shared cache is trimmed only to the limit stored in its directory. All files are published with an atomic rename, so many gibs processes
+ * can read and write the same cache directory at once.
+ */
+class ObjectCache
+{
+public:
+    explicit ObjectCache(const QString &directory, const qint64 maxSize);
+    static qint64 storedSizeLimit(const QString &directory);
+
+    bool isEnabled() const;
+    QString directory() const;
+    void setShared(const ObjectCachePtr &shared);
+    void setPathPrefix(const QString &name, const QString &path);
+
+    QByteArray key(const QString &compiler, const QStringList &arguments,
+                   const QByteArray &sourceChecksum);
+    bool restore(const QByteArray &key, const QString &objectFile,
+                 const QString &depfile);
+    void store(const QByteArray &key, const QString &objectFile,
+               const QString &depfile, const bool isShared = true);
+    void forgetChecksums();
+    void trim();
+
+    QStringList entryFiles(const QByteArray &key);
+    bool importFile(const QString &name, const QByteArray &data);
+
+    int hits() const;
+    int misses() const;
+
+protected:
+    bool find(const QByteArray &key, const QString &objectFile,
+              const QString &depfile);
+    QVector<QByteArray> matchingObjects(const QByteArray &key);
+    qint64 pruneManifests();
+    QString relativePath(const QString &path) const;
+    QByteArray compilerIdentity(const QString &compiler);
+    QByteArray fileChecksum(const QString &path);
+    QString manifestPath(const QByteArray &key) const;
+    QString objectPath(const QByteArray &key, const QString &suffix) const;
+    QString normalized(QString text) const;
+    QString expanded(QString text) const;
+    static bool writeFile(const QString &path, const QByteArray &data);
+
+    const QString mDirectory;
+    const qint64 mMaxSize;
+    int mHits = 0;
+    int mMisses = 0;
+    bool mHasStored = false;
+    ObjectCachePtr mShared;
+    struct Prefix {
+        QString placeholder;
+        QString path;
+        // Matches path when it is whole or followed by a separator
+        QRegularExpression expression;
+    };
+
+    // Longest paths come first
+    QVector<Prefix> mPrefixes;
+
+    // Compiler, its identity
+    QHash<QString, QByteArray> mCompilers;
+    // Path, checksum of file contents
+    QHash<QString, QByteArray> mChecksums;
+};
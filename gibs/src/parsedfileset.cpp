@@ -0,0 +1,35 @@
+#include "parsedfileset.h"
+
+#include <QFileInfo>
+
+/*!
+ * Adds \a path to the set. Returns true if it was not there yet - that is,
+ * if the caller is the one who should parse the file.
+ */
+bool ParsedFileSet::insert(const QString &path)
+{
+    const QString fileName(key(path));
+    if (mFiles.contains(fileName))
+        return false;
+
+    mFiles.insert(fileName);
+    return true;
+}
+
+/*!
+ * Returns true if a file with the same name as \a path is in the set.
+ */
+bool ParsedFileSet::contains(const QString &path) const
+{
+    return mFiles.contains(key(path));
+}
+
+void ParsedFileSet::clear()
+{
+    mFiles.clear();
+}
+
+QString ParsedFileSet::key(const QString &path)
+{
+    return QFileInfo(path).fileName();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QString>
+#include <QSet>
+
+/*!
+ * \brief The ParsedFileSet class is a set of files which have already been
+ * parsed (or have been scheduled for parsing) within a Scope.
+ *
+ * Files are recognised by their names, without the directory part. This
+ * matches how Scope::isParsed() has always worked.
+ *
+ * Used only from the main thread: scans running in worker threads (see
+ * FileParser::scan()) do not look at it.
+ */
+class ParsedFileSet
+{
+public:
+    bool insert(const QString &path);
+    bool contains(const QString &path) const;
+    void clear();
+
+    static QString key(const QString &path);
+
+private:
+    QSet<QString> mFiles;
+};
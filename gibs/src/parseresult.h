@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QDateTime>
+
+#include "gibs.h"
+
+/*!
+ * \brief The ParseResult struct holds everything FileParser::scan() has
+ * extracted from a single file.
+ *
+ * Includes, gibs commands and MOC markers are kept in \a events in the same
+ * order in which they appear in the file, and FileParser::apply() replays
+ * them in that order.
+ *
+ * Files are scanned in waves, though (see Scope::startWave()): headers
+ * included by a file are scanned and applied in the next wave, after all
+ * events of that file. Commands from an included header therefore take effect
+ * after the rest of the including file, not at the line of its #include.
+ */
+struct ParseResult {
+    enum EventType {
+        Include,
+        Command,
+        Moc,
+        //! Include in angle brackets. Not parsed, only counted for precompiled headers
+        LibraryInclude,
+        //! #define or #undef of a macro (other than include guard). Files which
+        //! change macros before their includes do not use precompiled headers
+        Define
+    };
+
+    struct Event {
+        EventType type;
+        QString value;
+    };
+
+    QString file;
+    //! Source file set by "source" command, or guessed from file name
+    QString source;
+    QVector<Event> events;
+    QByteArray checksum;
+    Gibs::FileStat stat;
+    QDateTime modified;
+    QDateTime created;
+    QByteArray contents;
+    //! Not empty if file could not be scanned
+    QString error;
+};
@@ -0,0 +1,198 @@
+#include "prefilter.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GIBS_PREFILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(GIBS_PREFILTER_SSE2) && defined(__GNUC__) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define GIBS_PREFILTER_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using FindFunction = const char *(*)(const char *, const char *);
+
+/*!
+ * Returns the index of lowest set bit in \a mask. \a mask must not be zero.
+ */
+static inline int firstBit(const unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline bool isCandidate(const char character)
+{
+    return (character == '#' or character == '/' or character == 'Q');
+}
+
+static inline bool isBlank(const char character)
+{
+    return (character == ' ' or character == '\t' or character == '\r'
+            or character == '\v' or character == '\f');
+}
+
+/*!
+ * Returns true if \a position (which is the first non-blank character in its
+ * line) starts one of the markers FileParser is interested in.
+ */
+static bool isMarker(const char *position, const char *end)
+{
+    const auto matches = [position, end](const char *marker) {
+        const size_t length = std::strlen(marker);
+        return (size_t(end - position) >= length
+                and std::memcmp(position, marker, length) == 0);
+    };
+
+    switch (*position) {
+    case '#':
+        return true;
+    case '/':
+        return (matches("//i") or matches("/*i"));
+    case 'Q':
+        return (matches("Q_OBJECT") or matches("Q_GADGET"));
+    default:
+        return false;
+    }
+}
+
+static const char *findScalar(const char *begin, const char *end)
+{
+    for (; begin < end; ++begin) {
+        if (isCandidate(*begin))
+            return begin;
+    }
+
+    return end;
+}
+
+#ifdef GIBS_PREFILTER_SSE2
+static const char *findSse2(const char *begin, const char *end)
+{
+    const __m128i hash = _mm_set1_epi8('#');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i q = _mm_set1_epi8('Q');
+
+    while (end - begin >= 16) {
+        const __m128i chunk = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(begin));
+        const __m128i matches = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk, hash),
+                                 _mm_cmpeq_epi8(chunk, slash)),
+                    _mm_cmpeq_epi8(chunk, q));
+        const int mask = _mm_movemask_epi8(matches);
+        if (mask != 0)
+            return begin + firstBit(unsigned(mask));
+        begin += 16;
+    }
+
+    return findScalar(begin, end);
+}
+#endif
+
+#ifdef GIBS_PREFILTER_AVX2
+__attribute__((target("avx2")))
+static const char *findAvx2(const char *begin, const char *end)
+{
+    const __m256i hash = _mm256_set1_epi8('#');
+    const __m256i slash = _mm256_set1_epi8('/');
+    const __m256i q = _mm256_set1_epi8('Q');
+
+    while (end - begin >= 32) {
+        const __m256i chunk = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *>(begin));
+        const __m256i matches = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, hash),
+                                    _mm256_cmpeq_epi8(chunk, slash)),
+                    _mm256_cmpeq_epi8(chunk, q));
+        const unsigned int mask = unsigned(_mm256_movemask_epi8(matches));
+        if (mask != 0)
+            return begin + firstBit(mask);
+        begin += 32;
+    }
+
+    return findSse2(begin, end);
+}
+#endif
+
+static FindFunction selectFindFunction()
+{
+#ifdef GIBS_PREFILTER_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &findAvx2;
+#endif
+#ifdef GIBS_PREFILTER_SSE2
+    return &findSse2;
+#else
+    return &findScalar;
+#endif
+}
+
+static const FindFunction find = selectFindFunction();
+
+/*!
+ * Returns a pointer to the beginning of the first line between \a begin and
+ * \a end which starts (after optional whitespace) with a marker. If there is
+ * no such line, \a end is returned.
+ *
+ * \a begin has to point to the beginning of a line.
+ */
+const char *Prefilter::nextCandidateLine(const char *begin, const char *end)
+{
+    const char *current = begin;
+    while (current < end) {
+        const char *candidate = find(current, end);
+        if (candidate == end)
+            return end;
+
+        const char *lineBegin = candidate;
+        while (lineBegin > current and *(lineBegin - 1) != '\n')
+            --lineBegin;
+
+        const char *first = lineBegin;
+        while (first < candidate and isBlank(*first))
+            ++first;
+
+        if (first == candidate and isMarker(candidate, end))
+            return lineBegin;
+
+        // Markers are only meaningful at the beginning of a line, the rest of
+        // this line can be skipped
+        const char *newline = static_cast<const char *>(
+                    std::memchr(candidate, '\n', size_t(end - candidate)));
+        if (newline == nullptr)
+            return end;
+        current = newline + 1;
+    }
+
+    return end;
+}
+
+/*!
+ * Returns the name of search implementation selected for current CPU.
+ */
+const char *Prefilter::implementationName()
+{
+#ifdef GIBS_PREFILTER_AVX2
+    if (find == &findAvx2)
+        return "AVX2";
+#endif
+#ifdef GIBS_PREFILTER_SSE2
+    if (find == &findSse2)
+        return "SSE2";
+#endif
+    return "scalar";
+}
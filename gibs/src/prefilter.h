@@ -0,0 +1,16 @@
+#pragma once
+
+/*!
+ * Prefilter quickly finds lines in C++ source code which might be interesting
+ * to FileParser: preprocessor directives (`#` at the start of a line), gibs
+ * commands (one-line and block comments) and Qt meta object markers
+ * (`Q_OBJECT`, `Q_GADGET`).
+ *
+ * All other lines can be skipped without looking at them in detail. Searching
+ * is vectorized (AVX2 or SSE2, chosen at runtime) with a scalar fallback for
+ * other platforms.
+ */
+namespace Prefilter {
+const char *nextCandidateLine(const char *begin, const char *end);
+const char *implementationName();
+}
@@ -2,32 +2,62 @@
 #include "gibs.h"
 #include "fileparser.h"
 #include "commandparser.h"
+#include "checksum.h"
+#include "cachebundle.h"
+#include "prefilter.h"
 
 #include <QProcess>
 #include <QFileInfo>
 #include <QFile>
+#include <QSaveFile>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QCryptographicHash>
-#include <QCoreApplication>
 
 #include <QDir>
 #include <QDirIterator>
 #include <QFileInfo>
 #include <QFile>
-#include <QTimer>
+#include <QStandardPaths>
+#include <QDateTime>
 
 // TODO: add categorized logging!
+#include <algorithm>
+
 #include <QDebug>
 
+namespace {
+// Heap comparator: higher priority first, then the one ready earlier
+bool readyLessThan(const MetaProcessPtr &left, const MetaProcessPtr &right)
+{
+    if (left->priority != right->priority)
+        return left->priority < right->priority;
+    return left->readyOrder > right->readyOrder;
+}
+}
+
 ProjectManager::ProjectManager(const Flags &flags, QObject *parent)
     : QObject(parent), mFlags(flags)
 {
     qRegisterMetaType<MetaProcess>("MetaProcess");
     qRegisterMetaType<MetaProcessPtr>("MetaProcessPtr");
 
-    // When all jobs are done, notify main.cpp that we can quit
+    const qint64 cacheSize = mFlags.cacheSize * 1024 * 1024;
+    const QString localCacheDir(QStandardPaths::writableLocation(
+                                    QStandardPaths::CacheLocation));
+    mObjectCache = ObjectCachePtr::create(localCacheDir, cacheSize);
+    mFileIndex = FileIndexPtr::create();
+    if (!mFlags.cacheDir.isEmpty()
+            and QDir(mFlags.cacheDir).absolutePath() != QDir(localCacheDir).absolutePath()) {
+        qInfo() << "Using shared object cache:" << mFlags.cacheDir;
+        mObjectCache->setShared(ObjectCachePtr::create(
+            mFlags.cacheDir, ObjectCache::storedSizeLimit(mFlags.cacheDir)));
+    }
+
+    // When all jobs are done, update the cache and notify main.cpp that we
+    // can quit
+    connect(this, &ProjectManager::jobQueueEmpty, this, &ProjectManager::onJobQueueEmpty);
     connect(this, &ProjectManager::jobQueueEmpty, this, &ProjectManager::finished);
 
     connect(this, &ProjectManager::error, this, &ProjectManager::onError);
@@ -58,6 +88,14 @@ void ProjectManager::start()
 {
     QByteArray tempScopeId;
 
+    updatePathPrefixes();
+
+    // Answers file lookups while parsing. Only changed directories are read
+    mFileIndex->update(QFileInfo(mFlags.inputFile).path());
+    if (mFlags.parseWholeFiles)
+        qDebug() << "Scanning files with" << Prefilter::implementationName()
+                 << "prefilter";
+
     // First, check if any files need to be recompiled
     if (mCacheEnabled) {
         const auto scopes = mScopes.values();
@@ -104,7 +142,7 @@ void ProjectManager::start()
         tempScopeId = scope->id();
     }
 
-    saveCache();
+    // Cache is saved once all scopes are parsed, see onScopeParsed()
 }
 
 void ProjectManager::clean()
@@ -123,6 +161,85 @@ void ProjectManager::onError(const QString &error)
     //mIsError = true;
 }
 
+/*!
+ * Packs gibs cache file and all objects needed to build the project from
+ * object cache into \a bundleFile. Only objects which are up to date with
+ * current sources are exported.
+ */
+bool ProjectManager::exportCache(const QString &bundleFile)
+{
+    if (!QFile::exists(Tags::gibsCacheFileName)) {
+        qWarning() << "Nothing to export, build the project first";
+        return false;
+    }
+
+    updatePathPrefixes();
+
+    CacheBundle bundle(bundleFile);
+    bundle.addFile(Tags::gibsCacheFileName, Tags::gibsCacheFileName);
+
+    int objects = 0;
+    for (const auto &scope : qAsConst(mScopes)) {
+        const auto keys = scope->objectCacheKeys();
+        for (const QByteArray &key : keys) {
+            const QStringList files(mObjectCache->entryFiles(key));
+            for (const QString &file : files) {
+                bundle.addFile(file, mObjectCache->directory() + "/" + file);
+            }
+
+            if (!files.isEmpty())
+                ++objects;
+        }
+    }
+
+    if (!bundle.write())
+        return false;
+
+    qInfo() << "Exported" << objects << "objects to:" << bundleFile;
+    return true;
+}
+
+/*!
+ * Seeds object cache with objects from \a bundleFile. Gibs cache file is
+ * taken from the bundle, too, unless there already is one.
+ *
+ * Must be called before loadCache().
+ */
+bool ProjectManager::importCache(const QString &bundleFile)
+{
+    if (!mObjectCache->isEnabled()) {
+        qWarning() << "Object cache is disabled, cannot import" << bundleFile;
+        return false;
+    }
+
+    CacheBundle bundle(bundleFile);
+    if (!bundle.open())
+        return false;
+
+    int failed = 0;
+    for (int i = 0; i < bundle.count(); ++i) {
+        const QString name(bundle.name(i));
+        if (name == Tags::gibsCacheFileName) {
+            if (QFile::exists(Tags::gibsCacheFileName)) {
+                qInfo() << "Keeping existing gibs cache file";
+                continue;
+            }
+
+            QSaveFile file(Tags::gibsCacheFileName);
+            if (!file.open(QFile::WriteOnly)
+                    or file.write(bundle.data(i)) != bundle.data(i).size()
+                    or !file.commit()) {
+                ++failed;
+            }
+        } else if (!mObjectCache->importFile(name, bundle.data(i))) {
+            ++failed;
+        }
+    }
+
+    qInfo() << "Imported" << bundle.count() - failed << "files from:" << bundleFile;
+    return (failed == 0);
+}
+
 /*!
  * Save necessary build info into GIBS cache file
  */
@@ -141,6 +258,7 @@ void ProjectManager::saveCache() const
 
     mainObject.insert(Tags::qtDir, mFlags.qtDir);
     mainObject.insert(Tags::inputFile, mFlags.inputFile);
+    mainObject.insert(Tags::checksumAlgorithm, Checksum::algorithm());
 
     QJsonArray scopesArray;
     const auto scopes = mScopes.values();
@@ -148,6 +266,7 @@ void ProjectManager::saveCache() const
         scopesArray.append(scope->toJson());
     }
     mainObject.insert(Tags::scopes, scopesArray);
+    mainObject.insert(Tags::fileIndex, mFileIndex->toJson());
 
     // TODO: save also all tools that need to be run!
 
@@ -185,22 +304,31 @@ void ProjectManager::loadCache()
     const auto document = QJsonDocument::fromJson(file.readAll());
     const QJsonObject mainObject(document.object());
 
-    mFlags.qtDir = mainObject.value(Tags::qtDir).toString();
+    // Qt dir configured on this machine wins, imported cache can come from
+    // another one
+    if (mFlags.qtDir.isEmpty())
+        mFlags.qtDir = mainObject.value(Tags::qtDir).toString();
+
+    const bool isSameChecksum = (mainObject.value(Tags::checksumAlgorithm)
+                                 .toString() == Checksum::algorithm());
+    if (!isSameChecksum) {
+        qInfo() << "Cache checksums were made with a different algorithm,"
+                << "all files will be checked again";
+    }
+
+    mFileIndex->fromJson(mainObject.value(Tags::fileIndex).toObject());
 
     const QJsonArray scopesArray = mainObject.value(Tags::scopes).toArray();
     for (const auto &scopeJson : scopesArray) {
         ScopePtr scope(Scope::fromJson(scopeJson.toObject(), mFlags));
+        if (!isSameChecksum)
+            scope->clearChecksums();
         mScopes.insert(scope->id(), scope);
         if (scope->name() == Tags::globalScope) {
             mGlobalScope = scope;
         }
 
-        connect(scope.data(), &Scope::error, this, &ProjectManager::error);
-        connect(scope.data(), &Scope::subproject,
-                this, &ProjectManager::onSubproject);
-        connect(scope.data(), &Scope::runProcess,
-                this, &ProjectManager::runProcess,
-                Qt::QueuedConnection);
+        connectScope(scope);
     }
 
     for (const auto &scope : qAsConst(mScopes)) {
@@ -265,27 +393,58 @@ void ProjectManager::onSubproject(const QByteArray &scopeId, const QString &path
     //qDebug() << "Subproject:" << scope->name() << "STARTING!";
     connectScope(scope);
 
-    // TODO: as subproject is being parsed, it should also set includepath and
-    // LIBS in the depending scope
-
+    // Include paths and LIBS are passed to the depending scope when the
+    // subproject finishes parsing, see Scope::onDependencyParsed()
     oldScope->dependOn(scope);
     if (!mGlobalScope.isNull()) {
         scope->mergeWith(mGlobalScope);
     }
     mScopes.insert(scope->id(), scope);
     scope->start(false, mFlags.quickMode);
-    //qDebug() << "Subproject:" << scope->name() << "FINISHED!";
-    // TODO: this has to be made conditional: only when subproject is actually
-    // a library (and not an app, or type zero, or plugin).
-    // Update INCLUDEPATH
-    oldScope->addIncludePaths(scope->includePaths());
-    oldScope->addIncludePaths(QStringList {scope->relativePath()});
-    // Update LIBS
-    oldScope->addLibs(QStringList {
-                          //"-L" + oldScope->relativePath() + "/" + newRelativePath,
-                          "-L" + mFlags.prefix(),
-                          "-l" + scope->targetName()
-                      });
+}
+
+/*!
+ * When all scopes are parsed, the cache can be saved. Job queue can also
+ * become empty for real only now.
+ */
+void ProjectManager::onScopeParsed()
+{
+    if (isParsing())
+        return;
+
+    saveCache();
+    runNextProcess();
+}
+
+/*!
+ * Compilation is done: dependencies reported by the compiler are stored in
+ * cache.
+ */
+void ProjectManager::onJobQueueEmpty(const bool isError)
+{
+    if (isError)
+        return;
+
+    // Generated headers have been written again since objects were restored
+    mObjectCache->forgetChecksums();
+
+    const auto scopes = mScopes.values();
+    for (const auto &scope : scopes) {
+        scope->readDepfiles();
+        scope->storeObjects();
+        scope->updateLinkSignature();
+        scope->updatePchSignature();
+        scope->removeStaleResponseFiles();
+        scope->recordDurations();
+    }
+
+    saveCache();
+
+    if (mObjectCache->isEnabled()) {
+        mObjectCache->trim();
+        qInfo() << "Object cache:" << mObjectCache->hits() << "hits,"
+                << mObjectCache->misses() << "misses";
+    }
 }
 
 void ProjectManager::onFeatureUpdated(const Gibs::Feature &feature)
@@ -313,12 +472,7 @@ void ProjectManager::onProcessErrorOccurred(QProcess::ProcessError _error)
     }
 
     // Remove process from the queue
-    for (int i = 0; i < mProcessQueue.count(); ++i) {
-        if (process == mProcessQueue.at(i)->process) {
-            mProcessQueue.remove(i);
-            break;
-        }
-    }
+    mProcesses.remove(process);
 
 //    for (int i = 0; i < mRunningJobs.count(); ++i) {
 //        if (process == mRunningJobs.at(i)) {
@@ -343,20 +497,32 @@ void ProjectManager::onProcessFinished(int exitCode, QProcess::ExitStatus exitSt
         return;
     }
 
+    // Remove process from the queue
+    const MetaProcessPtr mp(mProcesses.take(process));
+    if (!mp.isNull())
+        mp->duration = mp->timer.elapsed();
+
     if (exitCode != 0) {
-        emit error(QString("Process %1: finished with exit code %2 and status %3")
-                   .arg(process->program(),
-                        QString::number(exitCode),
-                        QString::number(exitStatus)));
+        if (!mp.isNull() and mp->canFail) {
+            qWarning() << "Process failed:" << mp->file;
+            mp->hasFailed = true;
+            // Scope can schedule other processes in its place
+            emit processFailed(mp);
+        } else {
+            emit error(QString("Process %1: finished with exit code %2 and status %3")
+                       .arg(process->program(),
+                            QString::number(exitCode),
+                            QString::number(exitStatus)));
+        }
     }
 
-    // Remove process from the queue
-    for (int i = 0; i < mProcessQueue.count(); ++i) {
-        if (process == mProcessQueue.at(i)->process) {
-            mProcessQueue.at(i)->hasFinished = true;
-            mProcessQueue.remove(i);
-            break;
-        }
+    if (!mp.isNull()) {
+        mp->hasFinished = true;
+        unblockDependents(mp);
+
+        const ScopePtr scope(mScopes.value(mp->scopeId));
+        if (!scope.isNull())
+            scope->onProcessFinished(mp);
     }
 
     for (int i = 0; i < mRunningJobs.count(); ++i) {
@@ -394,10 +560,134 @@ void ProjectManager::runProcess(const QString &app, const QStringList &arguments
     process->setArguments(arguments);
 
     mp->process.reset(process);
-    mProcessQueue.append(mp);
+    schedule(mp);
     runNextProcess();
 }
 
+/*!
+ * Adds \a mp to the build graph. It goes to the ready queue right away if all
+ * its dependencies have finished. Otherwise, the last of them to finish puts
+ * it there, see unblockDependents().
+ *
+ * Processes which \a mp waits for get more urgent: they are now followed by
+ * \a mp and everything which waits for it.
+ *
+ * Scopes which \a mp depends on are waited for in the same way, see
+ * onScopeFinished().
+ */
+void ProjectManager::schedule(const MetaProcessPtr &mp)
+{
+    mProcesses.insert(mp->process.data(), mp);
+    mp->isScheduled = true;
+    mp->pendingDependencies = 0;
+    raisePriority(mp, mp->estimatedDuration());
+    for (const MetaProcessPtr &dependency : qAsConst(mp->fileDependencies)) {
+        if (dependency.isNull() or dependency->hasFinished)
+            continue;
+
+        ++mp->pendingDependencies;
+        dependency->dependents.append(mp);
+        raisePriority(dependency, dependency->estimatedDuration() + mp->priority);
+    }
+
+    for (const QByteArray &scopeId : qAsConst(mp->scopeDepenencies)) {
+        const ScopePtr scope(mScopes.value(scopeId));
+        if (scope.isNull() or scope->isFinished())
+            continue;
+
+        ++mp->pendingDependencies;
+        mScopeWaiters.insert(scopeId, mp);
+    }
+
+    if (mp->pendingDependencies == 0)
+        makeReady(mp);
+}
+
+/*!
+ * \a mp has finished: processes waiting for it have one dependency less.
+ * Those which have none left are put into the ready queue.
+ */
+void ProjectManager::unblockDependents(const MetaProcessPtr &mp)
+{
+    for (const auto &weakDependent : qAsConst(mp->dependents)) {
+        const MetaProcessPtr dependent(weakDependent.toStrongRef());
+        if (dependent.isNull() or dependent->hasFinished)
+            continue;
+
+        if (--dependent->pendingDependencies == 0)
+            makeReady(dependent);
+    }
+
+    mp->dependents.clear();
+}
+
+/*!
+ * All processes of scope with \a scopeId have finished: processes waiting for
+ * it have one dependency less.
+ */
+void ProjectManager::onScopeFinished(const QByteArray &scopeId)
+{
+    const QList<MetaProcessPtr> waiters(mScopeWaiters.values(scopeId));
+    mScopeWaiters.remove(scopeId);
+    for (const MetaProcessPtr &mp : waiters) {
+        if (mp->hasFinished)
+            continue;
+
+        if (--mp->pendingDependencies == 0)
+            makeReady(mp);
+    }
+}
+
+void ProjectManager::makeReady(const MetaProcessPtr &mp)
+{
+    mp->readyOrder = mReadyCount++;
+    mp->isReady = true;
+    mReadyQueue.append(mp);
+    if (mIsReadyQueueSorted)
+        std::push_heap(mReadyQueue.begin(), mReadyQueue.end(), readyLessThan);
+}
+
+/*!
+ * Returns ready process which lies on the longest path to the end of the
+ * build. That way long compilations, and those which block linking of many
+ * targets, start first and do not keep the other jobs waiting at the end.
+ * Among processes of equal priority, the one which became ready first wins.
+ */
+MetaProcessPtr ProjectManager::takeReady()
+{
+    if (!mIsReadyQueueSorted) {
+        std::make_heap(mReadyQueue.begin(), mReadyQueue.end(), readyLessThan);
+        mIsReadyQueueSorted = true;
+    }
+
+    std::pop_heap(mReadyQueue.begin(), mReadyQueue.end(), readyLessThan);
+    const MetaProcessPtr mp(mReadyQueue.takeLast());
+    mp->isReady = false;
+    return mp;
+}
+
+/*!
+ * Sets priority of \a mp to \a priority if it is higher than current one,
+ * and passes the increase on to processes \a mp waits for.
+ */
+void ProjectManager::raisePriority(const MetaProcessPtr &mp, const qint64 priority)
+{
+    if (priority <= mp->priority or mp->hasFinished)
+        return;
+
+    mp->priority = priority;
+    // Heap is rebuilt once, before next process is taken from it. Processes
+    // which are not in it yet are put in their place by makeReady()
+    if (mp->isReady)
+        mIsReadyQueueSorted = false;
+
+    for (const MetaProcessPtr &dependency : qAsConst(mp->fileDependencies)) {
+        if (dependency.isNull())
+            continue;
+        raisePriority(dependency, dependency->estimatedDuration() + priority);
+    }
+}
+
 void ProjectManager::runNextProcess()
 {
     if (mIsError) {
@@ -407,50 +697,47 @@ void ProjectManager::runNextProcess()
     }
 
     // TODO: use these counts to create a progress bar as in cmake!
-    //qDebug() << "Running jobs:" << mRunningJobs.count() << "max jobs:" << mFlags.jobs << "process queue" << mProcessQueue.count();
-
-    // Run next process if max number of jobs is not exceeded
-    if ((mProcessQueue.count() > 0) and (mRunningJobs.count() < mFlags.jobs())) {
-        for (int i = 0; i < mProcessQueue.count() and (mRunningJobs.count() < mFlags.jobs()); ++i) {
-            const auto mp = mProcessQueue.at(i);
-            if (mp->hasFinished or !mp->canRun() or mp->process->state() == QProcess::Running
-                    or mp->process->state() == QProcess::Starting) {
-                continue;
-            }
+    //qDebug() << "Running jobs:" << mRunningJobs.count() << "max jobs:" << mFlags.jobs << "process queue" << mProcesses.count();
 
-            if (mp->scopeDepenencies.isEmpty() == false) {
-                const QString blockee(nextBlockingScopeName(mp));
-                if (!blockee.isEmpty()) {
-                    qDebug() << "Waiting for scope:" << blockee;
-                    //QCoreApplication::instance()->processEvents();
-                    //continue;
-                    QTimer::singleShot(16, this, &ProjectManager::runNextProcess);
-                }
-            }
+    // Run ready processes if max number of jobs is not exceeded
+    if (!mReadyQueue.isEmpty() and (mRunningJobs.count() < mFlags.jobs())) {
+        while (!mReadyQueue.isEmpty() and (mRunningJobs.count() < mFlags.jobs())) {
+            const MetaProcessPtr mp(takeReady());
+            if (mp->hasFinished)
+                continue;
 
+            mp->timer.start();
+            mp->startTime = QDateTime::currentMSecsSinceEpoch() * 1000000;
             mRunningJobs.append(mp->process);
-            qInfo() << "Running next process:" << i << mRunningJobs.last()->program() << mRunningJobs.last()->arguments().join(" ");
+            qInfo() << "Running next process:" << mp->file << mRunningJobs.last()->program() << mRunningJobs.last()->arguments().join(" ");
             mRunningJobs.last()->start();
         }
-
-        // Start working asap
-        QCoreApplication::instance()->processEvents();
     }
 
-    if (mProcessQueue.isEmpty()) {
+    // More jobs can still come from scopes which are being parsed
+    if (mProcesses.isEmpty() and !isParsing()) {
         emit jobQueueEmpty(mIsError);
     }
 }
 
-QString ProjectManager::nextBlockingScopeName(const MetaProcessPtr &mp) const
+bool ProjectManager::isParsing() const
 {
-    for (const auto &scopeId : qAsConst(mp->scopeDepenencies)) {
-        if (mScopes.value(scopeId)->isFinished() == false) {
-            return mScopes.value(scopeId)->name();
-        }
+    for (const auto &scope : qAsConst(mScopes)) {
+        if (scope->isParsing())
+            return true;
     }
 
-    return QString();
+    return false;
+}
+
+/*!
+ * Object cache replaces paths which differ between checkouts with
+ * placeholders.
+ */
+void ProjectManager::updatePathPrefixes()
+{
+    mObjectCache->setPathPrefix(Tags::sourceRootPrefix, QDir::currentPath());
+    mObjectCache->setPathPrefix(Tags::qtDirPrefix, mFlags.qtDir);
 }
 
 void ProjectManager::connectScope(const ScopePtr &scope)
@@ -464,4 +751,13 @@ void ProjectManager::connectScope(const ScopePtr &scope)
             Qt::QueuedConnection);
     connect(scope.data(), &Scope::feature,
             this, &ProjectManager::onFeatureUpdated);
+    scope->setObjectCache(mObjectCache);
+    scope->setFileIndex(mFileIndex);
+    connect(this, &ProjectManager::processFailed,
+            scope.data(), &Scope::onProcessFailed);
+    connect(scope.data(), &Scope::parsingFinished,
+            this, &ProjectManager::onScopeParsed,
+            Qt::QueuedConnection);
+    connect(scope.data(), &Scope::finished,
+            this, &ProjectManager::onScopeFinished);
 }
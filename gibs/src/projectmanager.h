@@ -29,6 +29,8 @@ public:
     QString qtDir() const;
 
     void loadCache();
+    bool exportCache(const QString &bundleFile);
+    bool importCache(const QString &bundleFile);
     void loadCommands();
     void loadFeatures(const QHash<QString, Gibs::Feature> &features);
 
@@ -36,6 +38,7 @@ signals:
     void error(const QString &error) const;
     void finished(const int returnValue) const;
     void jobQueueEmpty(const bool isError) const;
+    void processFailed(const MetaProcessPtr &mp) const;
 
 public slots:
     void start();
@@ -48,6 +51,9 @@ protected slots:
     void saveCache() const;
     void onSubproject(const QByteArray &scopeId, const QString &path);
     void onFeatureUpdated(const Gibs::Feature &feature);
+    void onScopeParsed();
+    void onScopeFinished(const QByteArray &scopeId);
+    void onJobQueueEmpty(const bool isError);
 
     // Process handling
     void onStarted();
@@ -56,22 +62,38 @@ protected slots:
 
 private:
     void runNextProcess();
-    QString nextBlockingScopeName(const MetaProcessPtr &mp) const;
+    void schedule(const MetaProcessPtr &mp);
+    void unblockDependents(const MetaProcessPtr &mp);
+    void makeReady(const MetaProcessPtr &mp);
+    MetaProcessPtr takeReady();
+    void raisePriority(const MetaProcessPtr &mp, const qint64 priority);
+    bool isParsing() const;
     void scanForIncludes(const QString &path);
     void connectScope(const ScopePtr &scope);
+    void updatePathPrefixes();
 
     bool mIsError = false;
     bool mCacheEnabled = false;
 
     Flags mFlags;
     ScopePtr mGlobalScope;
+    ObjectCachePtr mObjectCache;
+    FileIndexPtr mFileIndex;
 
     // scopeId, scope
     QHash<QByteArray, ScopePtr> mScopes;
     // name, Feature
     QHash<QString, Gibs::Feature> mFeatures;
 
-    QVector<MetaProcessPtr> mProcessQueue;
+    // Scope id, scheduled processes waiting for it to finish
+    QMultiHash<QByteArray, MetaProcessPtr> mScopeWaiters;
+    // Scheduled processes which have not finished yet
+    QHash<QProcess *, MetaProcessPtr> mProcesses;
+    // Processes whose dependencies have all finished. Heap ordered by
+    // priority, see takeReady()
+    QVector<MetaProcessPtr> mReadyQueue;
+    bool mIsReadyQueueSorted = true;
+    quint64 mReadyCount = 0;
     QVector<ProcessPtr> mRunningJobs;
     QHash<QProcess*,QByteArray> mFileData;
 };
@@ -3,14 +3,73 @@
 #include "tags.h"
 #include "metaprocess.h"
 #include "fileparser.h"
+#include "checksum.h"
 
 #include <QDirIterator>
 #include <QCryptographicHash>
+#include <QtConcurrent/QtConcurrentMap>
 #include <QJsonArray>
 #include <QProcess>
+#include <QSaveFile>
+#include <QMap>
+
+#include <algorithm>
 
 #include <QDebug>
 #include <QJsonDocument>
+
+namespace {
+// Precompiled header is built only if there are at least this many source
+// files (with fewer, building it costs more than it saves). Library header
+// goes into it if at least half of them include it
+const int minPchSources = 8;
+const QLatin1String pchHeaderSuffix("_pch.h");
+// Unity batch files are named: gibs_unity_<target>_<number>.cpp
+const QLatin1String unityPrefix("gibs_unity_");
+// Sources which compile faster than this (in ms) are compiled in groups with
+// --multi-compile. Groups are filled up to smallGroupTime
+const qint64 smallSourceTime = 100;
+const qint64 smallGroupTime = 500;
+// Version of scan results stored in cache. Bump it when scanner starts to
+// produce different events, so that all files are scanned again
+const int scanVersion = 2;
+// Response files are named: <target>_<16 hex digits of checksum>.rsp
+const QLatin1String responseFileSuffix(".rsp");
+const QLatin1String responseFileChecksumPattern("_????????????????");
+
+/*!
+ * Returns name of Qt \a module as used in its include dir and library name,
+ * without "Qt" prefix (for example "Core" for "core").
+ */
+QString qtModuleName(const QString &module)
+{
+    if (module == Tags::quickcontrols2)
+        return QStringLiteral("QuickControls2");
+    if (module == Tags::quickwidgets)
+        return QStringLiteral("QuickWidgets");
+    return Gibs::capitalizeFirstLetter(module);
+}
+
+/*!
+ * Returns \a argument escaped for a response file: whitespace, quotes and
+ * backslashes are prefixed with a backslash.
+ */
+QByteArray responseFileArgument(const QString &argument)
+{
+    const QByteArray utf8(argument.toUtf8());
+    QByteArray result;
+    result.reserve(utf8.size());
+    for (const char character : utf8) {
+        if (character == ' ' or character == '\t' or character == '\n'
+                or character == '\r' or character == '"' or character == '\''
+                or character == '\\') {
+            result.append('\\');
+        }
+        result.append(character);
+    }
+    return result;
+}
+}
 Scope::Scope(const QString &name,
              const QString &relativePath,
              const Flags &flags,
@@ -29,6 +88,9 @@ Scope::Scope(const QString &name,
     // this pre-set name will be replaced.
     setTargetName(QFileInfo(name).absoluteDir().dirName());
     qDebug() << "Target name is:" << targetName();
+
+    connect(&mParseWatcher, &QFutureWatcher<ParseResult>::finished,
+            this, &Scope::onWaveScanned);
 }
 
 // Protected constructor - used in fromJson().
@@ -40,6 +102,8 @@ Scope::Scope(const QByteArray &id,
       mRelativePath(relativePath),
       mName(name), mId(id)
 {
+    connect(&mParseWatcher, &QFutureWatcher<ParseResult>::finished,
+            this, &Scope::onWaveScanned);
 }
 
 QString Scope::name() const
@@ -77,7 +141,7 @@ QJsonObject Scope::toJson() const
     object.insert(Tags::relativePath, mRelativePath);
     //object.insert(Tags::prefix, mFlags.prefix());
     //object.insert(Tags::qtDir, mFlags.qtDir());
-    //object.insert(Tags::parse_whole_files, mFlags.parseWholeFiles());
+    object.insert(Tags::scanSignature, QString(mScanSignature.toHex()));
     object.insert(Tags::parsedFiles, filesArray);
     object.insert(Tags::scopeTargetName, mTargetName);
     object.insert(Tags::targetType, mTargetType);
@@ -86,8 +150,60 @@ QJsonObject Scope::toJson() const
     object.insert(Tags::qtModules, QJsonArray::fromStringList(mQtModules));
     object.insert(Tags::defines, QJsonArray::fromStringList(mCustomDefines));
     object.insert(Tags::includes, QJsonArray::fromStringList(mCustomIncludes));
+    object.insert(Tags::autoIncludes, QJsonArray::fromStringList(mAutoIncludes));
+
+    QStringList usedAutoIncludes;
+    for (const QString &dir : qAsConst(mAutoIncludes)) {
+        if (mUsedAutoIncludes.contains(dir))
+            usedAutoIncludes.append(dir);
+    }
+    object.insert(Tags::usedAutoIncludes,
+                  QJsonArray::fromStringList(usedAutoIncludes));
     object.insert(Tags::libs, QJsonArray::fromStringList(mCustomLibs));
 
+    QJsonObject statsObject;
+    for (auto it = mDependencyStats.constBegin();
+         it != mDependencyStats.constEnd(); ++it) {
+        statsObject.insert(it.key(), QJsonArray {
+                               QString::number(it.value().inode),
+                               it.value().size,
+                               QString::number(it.value().modified)
+                           });
+    }
+    object.insert(Tags::dependencyStats, statsObject);
+
+    QJsonObject dependentsObject;
+    for (auto it = mDependents.constBegin(); it != mDependents.constEnd(); ++it) {
+        dependentsObject.insert(it.key(), QJsonArray::fromStringList(it.value()));
+    }
+    object.insert(Tags::dependents, dependentsObject);
+    object.insert(Tags::linkSignature, QString(mLinkSignature.toHex()));
+    object.insert(Tags::pchSignature, QString(mPchSignature.toHex()));
+
+    QStringList unityExcluded;
+    for (const QString &file : qAsConst(mUnityExcluded))
+        unityExcluded.append(file);
+    unityExcluded.sort();
+    object.insert(Tags::unityExcluded, QJsonArray::fromStringList(unityExcluded));
+
+    QJsonObject unityFailedObject;
+    for (auto it = mUnityFailed.constBegin(); it != mUnityFailed.constEnd(); ++it) {
+        unityFailedObject.insert(it.key(), it.value());
+    }
+    object.insert(Tags::unityFailed, unityFailedObject);
+
+    QJsonObject durationsObject;
+    for (auto it = mJobDurations.constBegin(); it != mJobDurations.constEnd(); ++it) {
+        durationsObject.insert(it.key(), it.value());
+    }
+    object.insert(Tags::jobDurations, durationsObject);
+
+    QJsonObject cacheKeysObject;
+    for (auto it = mObjectCacheKeys.constBegin(); it != mObjectCacheKeys.constEnd(); ++it) {
+        cacheKeysObject.insert(it.key(), QString(it.value().toHex()));
+    }
+    object.insert(Tags::objectCacheKeys, cacheKeysObject);
+
     return object;
 }
 
@@ -106,7 +222,7 @@ Scope *Scope::fromJson(const QJsonObject &json, const Flags &flags)
     for (const auto &file : filesArray) {
         FileInfo fileInfo;
         fileInfo.fromJsonArray(file.toArray());
-        scope->mParsedFiles.insert(fileInfo.path, fileInfo);
+        scope->insertParsedFile(fileInfo);
     }
 
     const QJsonArray scopesArray = json.value(Tags::scopeDependencies).toArray();
@@ -118,14 +234,66 @@ Scope *Scope::fromJson(const QJsonObject &json, const Flags &flags)
     scope->setTargetName(json.value(Tags::scopeTargetName).toString());
     scope->setTargetType(json.value(Tags::targetType).toString());
     scope->mTargetLibType = json.value(Tags::targetLibType).toString();
+    scope->mScanSignature = QByteArray::fromHex(
+                json.value(Tags::scanSignature).toString().toLatin1());
     scope->setQtModules(
                 Gibs::jsonArrayToStringList(json.value(Tags::qtModules).toArray()));
     scope->addDefines(
                 Gibs::jsonArrayToStringList(json.value(Tags::defines).toArray()));
     scope->addIncludePaths(
                 Gibs::jsonArrayToStringList(json.value(Tags::includes).toArray()));
+    scope->mAutoIncludes = Gibs::jsonArrayToStringList(
+                json.value(Tags::autoIncludes).toArray());
+    const QStringList usedAutoIncludes(Gibs::jsonArrayToStringList(
+                                           json.value(Tags::usedAutoIncludes).toArray()));
+    for (const QString &dir : usedAutoIncludes) {
+        scope->mUsedAutoIncludes.insert(dir);
+    }
     scope->addLibs(
                 Gibs::jsonArrayToStringList(json.value(Tags::libs).toArray()));
+
+    const QJsonObject statsObject(json.value(Tags::dependencyStats).toObject());
+    for (auto it = statsObject.constBegin(); it != statsObject.constEnd(); ++it) {
+        const QJsonArray statArray(it.value().toArray());
+        Gibs::FileStat stat;
+        stat.inode = statArray.at(0).toString().toULongLong();
+        stat.size = qint64(statArray.at(1).toDouble(-1));
+        stat.modified = statArray.at(2).toString().toLongLong();
+        scope->mDependencyStats.insert(it.key(), stat);
+    }
+
+    scope->mLinkSignature = QByteArray::fromHex(
+                json.value(Tags::linkSignature).toString().toLatin1());
+    scope->mPchSignature = QByteArray::fromHex(
+                json.value(Tags::pchSignature).toString().toLatin1());
+    const QStringList unityExcluded(Gibs::jsonArrayToStringList(
+                                        json.value(Tags::unityExcluded).toArray()));
+    for (const QString &file : unityExcluded) {
+        scope->mUnityExcluded.insert(file);
+    }
+    const QJsonObject unityFailedObject(json.value(Tags::unityFailed).toObject());
+    for (auto it = unityFailedObject.constBegin(); it != unityFailedObject.constEnd(); ++it) {
+        scope->mUnityFailed.insert(it.key(), it.value().toString());
+    }
+
+    const QJsonObject durationsObject(json.value(Tags::jobDurations).toObject());
+    for (auto it = durationsObject.constBegin(); it != durationsObject.constEnd(); ++it) {
+        scope->mJobDurations.insert(it.key(), qint64(it.value().toDouble()));
+    }
+
+    const QJsonObject dependentsObject(json.value(Tags::dependents).toObject());
+    for (auto it = dependentsObject.constBegin();
+         it != dependentsObject.constEnd(); ++it) {
+        scope->mDependents.insert(it.key(), Gibs::jsonArrayToStringList(
+                                      it.value().toArray()));
+    }
+
+    const QJsonObject cacheKeysObject(json.value(Tags::objectCacheKeys).toObject());
+    for (auto it = cacheKeysObject.constBegin();
+         it != cacheKeysObject.constEnd(); ++it) {
+        scope->mObjectCacheKeys.insert(it.key(), QByteArray::fromHex(
+                                           it.value().toString().toLatin1()));
+    }
     // TODO: missing some properties
 
     return scope;
@@ -157,6 +325,7 @@ void Scope::mergeWith(const ScopePtr &other)
     mCustomIncludes = other->mCustomIncludes; //
     mCustomIncludeFlags = other->customIncludeFlags();
     //mParsedFiles;
+    resetCompilerArguments();
 }
 
 void Scope::dependOn(const ScopePtr &other)
@@ -165,16 +334,28 @@ void Scope::dependOn(const ScopePtr &other)
         mScopeDependencyIds.append(other->id());
     if (!mScopeDependencies.contains(other))
         mScopeDependencies.append(other);
+    mScopeHeaders.clear();
+
+    connect(other.data(), &Scope::parsingFinished,
+            this, &Scope::onDependencyParsed, Qt::UniqueConnection);
 }
 
+/*!
+ * Returns true if this scope has finished parsing and all its processes have
+ * finished. Processes waiting for this scope can run then.
+ */
 bool Scope::isFinished() const
 {
-    for (const auto &mp : qAsConst(mProcessQueue)) {
-        if (mp->hasFinished == false)
-            return false;
-    }
+    return mHasFinishedParsing and mUnfinishedProcesses == 0;
+}
 
-    return false;
+/*!
+ * Returns true if this scope has been started, but has not finished parsing
+ * yet.
+ */
+bool Scope::isParsing() const
+{
+    return mHasStarted and !mHasFinishedParsing;
 }
 
 QList<FileInfo> Scope::parsedFiles() const
@@ -185,6 +366,21 @@ QList<FileInfo> Scope::parsedFiles() const
 void Scope::insertParsedFile(const FileInfo &fileInfo)
 {
     mParsedFiles.insert(fileInfo.path, fileInfo);
+    mFileKeys.insert(ParsedFileSet::key(fileInfo.path), fileInfo.path);
+    if (!fileInfo.generatedFile.isEmpty())
+        mFileKeys.insert(ParsedFileSet::key(fileInfo.generatedFile), fileInfo.path);
+    mParsedSet.insert(fileInfo.path);
+}
+
+/*!
+ * Forgets checksums of all parsed files. Used when cache was created with
+ * a different checksum algorithm - all files will be treated as changed.
+ */
+void Scope::clearChecksums()
+{
+    for (auto &info : mParsedFiles) {
+        info.checksum.clear();
+    }
 }
 
 FileInfo Scope::parsedFile(const QString &path) const
@@ -192,18 +388,13 @@ FileInfo Scope::parsedFile(const QString &path) const
     return mParsedFiles.value(path);
 }
 
+/*!
+ * Returns true if a file with the same name as \a path has already been parsed
+ * or is scheduled for parsing.
+ */
 bool Scope::isParsed(const QString &path) const
 {
-    const auto fileName = QFileInfo(path).fileName();
-    const auto files = mParsedFiles.keys();
-    for (const auto &file : files) {
-        if (QFileInfo(file).fileName() == fileName) {
-            return true;
-        }
-    }
-
-    return false;
-    //return mParsedFiles.contains(path);
+    return mParsedSet.contains(path);
 }
 
 void Scope::addIncludePaths(const QStringList &includes)
@@ -216,12 +407,47 @@ void Scope::addIncludePaths(const QStringList &includes)
             mCustomIncludeFlags.append(inc);
         }
     }
+    resetCompilerArguments();
     qInfo() << "Updating custom includes:" << mCustomIncludes;
 }
 
+/*!
+ * Returns all include paths in which gibs looks for files, including all
+ * directories found by autoScanForIncludes().
+ */
 QStringList Scope::includePaths() const
 {
-    return mCustomIncludes;
+    return mCustomIncludes + scopeIncludePaths() + mAutoIncludes;
+}
+
+/*!
+ * Returns include paths which are passed to the compiler: custom ones, those
+ * of scopes this one depends on and those auto include dirs in which some
+ * include was found.
+ */
+QStringList Scope::usedIncludePaths() const
+{
+    QStringList result(mCustomIncludes + scopeIncludePaths());
+    for (const QString &dir : qAsConst(mAutoIncludes)) {
+        if (mUsedAutoIncludes.contains(dir))
+            result.append(dir);
+    }
+    return result;
+}
+
+/*!
+ * Returns include paths of scopes this one depends on, and dirs of these
+ * scopes. They are final only once these scopes have finished parsing.
+ */
+QStringList Scope::scopeIncludePaths() const
+{
+    QStringList result;
+    for (const auto &scope : qAsConst(mScopeDependencies)) {
+        result.append(scope->usedIncludePaths());
+        result.append(scope->relativePath());
+    }
+    result.removeDuplicates();
+    return result;
 }
 
 QStringList Scope::customIncludeFlags() const
@@ -236,6 +462,9 @@ QStringList Scope::customIncludeFlags() const
  *
  * \a path can be a file - the function will search for all subdirs of the
  * directory where that file is located.
+ *
+ * Only directories in which some include of this scope is found are passed
+ * to the compiler, see useAutoInclude().
  */
 void Scope::autoScanForIncludes()
 {
@@ -250,7 +479,10 @@ void Scope::autoScanForIncludes()
         result.append(it.next());
     }
 
-    addIncludePaths(result);
+    for (const QString &dir : qAsConst(result)) {
+        if (!mAutoIncludes.contains(dir) and !mCustomIncludes.contains(dir))
+            mAutoIncludes.append(dir);
+    }
 }
 
 void Scope::setTargetName(const QString &target)
@@ -284,6 +516,7 @@ void Scope::addDefines(const QStringList &defines)
             mCustomDefineFlags.append(def);
         }
     }
+    resetCompilerArguments();
 }
 
 void Scope::addLibs(const QStringList &libs)
@@ -292,23 +525,455 @@ void Scope::addLibs(const QStringList &libs)
     mCustomLibs.removeDuplicates();
 }
 
+/*!
+ * Schedules compilation of \a file and returns the name of the object file
+ * which will be produced. If parsing is in progress, compilation is postponed
+ * until the file which requested it, and all files it includes, are parsed.
+ *
+ * When piping is on, contents of \a fileInfo are fed into the compiler.
+ */
 QString Scope::compile(const QString &file, const FileInfo &fileInfo)
 {
     if (mIsError)
         return QString();
 
+    const QString objectFile(QFileInfo(file).baseName() + ".o");
+
+    // Can be requested twice, for example when both the source and one of
+    // its dependencies have changed
+    if (mScheduledObjects.contains(objectFile))
+        return objectFile;
+    mScheduledObjects.insert(objectFile);
+
+    if (mIsParsing or (isWaitingForScopes()
+                       and includeUsage(QStringList { file }).usesScopes)) {
+        mPendingCompiles.append(PendingCompile { file, objectFile,
+                                                 fileInfo.contents,
+                                                 mCurrentFile });
+    } else {
+        runCompiler(file, objectFile, fileInfo.contents);
+    }
+
+    return objectFile;
+}
+
+/*!
+ * Compiles source \a file found during parsing. In unity mode, the file is
+ * only queued, it is compiled in a unity batch when parsing is finished (see
+ * compileUnity()). Returns object file of \a file, if it is already known.
+ */
+QString Scope::compileSource(const QString &file, const FileInfo &fileInfo)
+{
+    if (mFlags.unity and mUnityFailed.contains(file))
+        retryUnity(mUnityFailed.value(file));
+
+    const QString previousObject(parsedFile(file).objectFile);
+    if (mFlags.unity and isUnityCandidate(file)) {
+        mUnityQueue.insert(file);
+        return isUnityObject(previousObject)? previousObject : QString();
+    }
+
+    const QString objectFile(compile(file, fileInfo));
+
+    // Source has left its unity batch, the batch has to be built without it
+    if (isUnityObject(previousObject)) {
+        mDirtyUnityBatches.insert(previousObject);
+        auto it = mParsedFiles.find(file);
+        if (it != mParsedFiles.end())
+            it->objectFile = objectFile;
+    }
+
+    return objectFile;
+}
+
+/*!
+ * One of the sources taken out of unity batch \a batchObject (see
+ * onProcessFailed()) has to be recompiled, so the error which broke the batch
+ * might be fixed now. All sources of that batch are queued for unity batches
+ * again. If they still fail to compile together, they are taken out again.
+ */
+void Scope::retryUnity(const QString &batchObject)
+{
+    for (auto it = mUnityFailed.begin(); it != mUnityFailed.end(); ) {
+        if (it.value() != batchObject) {
+            ++it;
+            continue;
+        }
+
+        // Separate object is replaced by the batch
+        const QString objectFile(parsedFile(it.key()).objectFile);
+        if (!objectFile.isEmpty() and !isUnityObject(objectFile)) {
+            Gibs::removeFile(objectFile);
+            Gibs::removeFile(depfileName(objectFile));
+        }
+
+        mUnityQueue.insert(it.key());
+        it = mUnityFailed.erase(it);
+    }
+}
+
+bool Scope::isUnityCandidate(const QString &file) const
+{
+    return (QFileInfo(file).suffix() != "c" and !mUnityExcluded.contains(file)
+            and !mUnityFailed.contains(file));
+}
+
+bool Scope::isUnityObject(const QString &objectFile)
+{
+    return (objectFile.startsWith(unityPrefix) and objectFile.endsWith(".o"));
+}
+
+QString Scope::unitySourceFile(const QString &objectFile)
+{
+    return QFileInfo(objectFile).completeBaseName() + ".cpp";
+}
+
+/*!
+ * Puts queued sources into unity batches and compiles batches which have
+ * changed. A batch is a generated source file which includes several sources,
+ * so that common headers are parsed only once.
+ *
+ * Sources keep their batch between builds. New sources go to the batch with
+ * the lowest weight: compile time from previous builds if it is known for all
+ * sources, file size otherwise. If there are no batches yet, sources are
+ * divided into the number of batches set with --unity-batches (or one per job).
+ */
+void Scope::compileUnity()
+{
+    if (mUnityQueue.isEmpty() and mDirtyUnityBatches.isEmpty())
+        return;
+
+    // Batch object file, its sources
+    QMap<QString, QStringList> batches;
+    for (const auto &info : qAsConst(mParsedFiles)) {
+        if (isUnityObject(info.objectFile))
+            batches[info.objectFile].append(info.path);
+    }
+
+    QSet<QString> dirty(mDirtyUnityBatches);
+    QStringList newSources;
+    for (const QString &file : qAsConst(mUnityQueue)) {
+        const QString objectFile(mParsedFiles.value(file).objectFile);
+        if (isUnityObject(objectFile)) {
+            dirty.insert(objectFile);
+        } else {
+            newSources.append(file);
+        }
+    }
+    newSources.sort();
+
+    if (!newSources.isEmpty()) {
+        bool hasTimes = true;
+        for (const auto &info : qAsConst(mParsedFiles)) {
+            if ((isUnityObject(info.objectFile) or newSources.contains(info.path))
+                    and info.compileTime <= 0) {
+                hasTimes = false;
+                break;
+            }
+        }
+
+        const auto weight = [this, hasTimes](const QString &file) -> qint64 {
+            const auto it = mParsedFiles.constFind(file);
+            if (it == mParsedFiles.constEnd())
+                return 1;
+            return hasTimes? it->compileTime : qMax<qint64>(it->stat.size, 1);
+        };
+
+        // Weight, batch object file
+        QVector<QPair<qint64, QString>> bins;
+        for (auto it = batches.constBegin(); it != batches.constEnd(); ++it) {
+            qint64 total = 0;
+            for (const QString &file : it.value())
+                total += weight(file);
+            bins.append(qMakePair(total, it.key()));
+        }
+
+        if (bins.isEmpty()) {
+            const int count = qMin(newSources.size(), mFlags.unityBatches > 0?
+                                       mFlags.unityBatches : mFlags.jobs());
+            for (int i = 0; i < count; ++i) {
+                bins.append(qMakePair(qint64(0), unityPrefix + targetName()
+                                      + "_" + QString::number(i) + ".o"));
+            }
+        }
+
+        // Heaviest sources first, each goes to the lightest batch
+        std::stable_sort(newSources.begin(), newSources.end(),
+                         [&weight](const QString &left, const QString &right) {
+            return weight(left) > weight(right);
+        });
+
+        for (const QString &file : qAsConst(newSources)) {
+            auto lightest = std::min_element(bins.begin(), bins.end());
+            lightest->first += weight(file);
+            batches[lightest->second].append(file);
+            dirty.insert(lightest->second);
+
+            auto it = mParsedFiles.find(file);
+            if (it != mParsedFiles.end())
+                it->objectFile = lightest->second;
+        }
+    }
+
+    mUnityQueue.clear();
+    mDirtyUnityBatches.clear();
+
+    QStringList dirtyBatches;
+    for (const QString &objectFile : qAsConst(dirty))
+        dirtyBatches.append(objectFile);
+    dirtyBatches.sort();
+    for (const QString &objectFile : qAsConst(dirtyBatches)) {
+        QStringList sources(batches.value(objectFile));
+        sources.sort();
+
+        const QString unitySource(unitySourceFile(objectFile));
+        if (sources.isEmpty()) {
+            Gibs::removeFile(unitySource);
+            Gibs::removeFile(objectFile);
+            Gibs::removeFile(depfileName(objectFile));
+            continue;
+        }
+
+        QByteArray contents("// Generated by gibs, unity build\n");
+        for (const QString &source : qAsConst(sources)) {
+            contents.append("#include \"" + source.toUtf8() + "\"\n");
+        }
+
+        // Keep file date if contents are the same
+        if (Checksum::fileHash(unitySource) != Checksum::hash(contents.constData(),
+                                                              contents.size())) {
+            QSaveFile file(unitySource);
+            if (!file.open(QFile::WriteOnly) or file.write(contents) != contents.size()
+                    or !file.commit()) {
+                emit error("Could not write unity batch: " + unitySource);
+                return;
+            }
+        }
+
+        qInfo() << "Compiling unity batch:" << objectFile << "with"
+                << sources.size() << "sources";
+        mUnityBatches.insert(objectFile, sources);
+        mScheduledObjects.insert(objectFile);
+        runCompiler(unitySource, objectFile, contents);
+
+        // If batch does not compile, sources are compiled separately
+        const MetaProcessPtr mp(findDependency(objectFile));
+        if (!mp.isNull())
+            mp->canFail = true;
+    }
+}
+
+/*!
+ * Runs the compiler for \a file, producing \a objectFile. If piping is on,
+ * \a contents are sent to the compiler instead of file path.
+ */
+void Scope::runCompiler(const QString &file, const QString &objectFile,
+                        const QByteArray &contents)
+{
+    const QString compiler(compilerCommand(file));
+    const bool isCFile = (QFileInfo(file).suffix() == "c");
+
+    //qInfo() << "Compiling:" << file << "into:" << objectFile;
+    // Precompiled header is used automatically, if it is ready. It is
+    // included before everything else, so it would not see macros which the
+    // file sets before its includes
+    const QStringList files(mUnityBatches.value(objectFile, { file }));
+    bool isUsingPch = (!mPchHeader.isEmpty() and !isCFile);
+    IncludeUsage usage(includeUsage(files, isUsingPch? mPchHeaders : QStringList()));
+    if (isUsingPch and usage.definesMacros) {
+        isUsingPch = false;
+        usage = includeUsage(files);
+    }
+
+    // Only arguments specific to this file, common ones are added below
+    QStringList arguments(includeFlags(usage));
+    if (isUsingPch) {
+        arguments.append({ "-include", mPchHeader });
+    }
+
+    // Ask the compiler which headers it has really used
+    if (!mCompiler.depfileFlags.isEmpty()) {
+        const QString depfile(depfileName(objectFile));
+        for (const QString &flag : qAsConst(mCompiler.depfileFlags)) {
+            arguments.append(flag.contains("%1")? flag.arg(depfile) : flag);
+        }
+        mCompiledObjects.insert(objectFile, QDateTime::currentMSecsSinceEpoch()
+                                * 1000000);
+    }
+
+    arguments.append({ "-o", objectFile });
+    if (mFlags.pipe()) {
+        arguments.append({ "-x", "c++", "-" });
+    } else {
+        arguments.append(file);
+    }
+
+    // Reuse object compiled earlier from the same inputs. Depfile is needed
+    // to verify headers
+    if (!mCompiler.depfileFlags.isEmpty() and !mObjectCache.isNull()
+            and mObjectCache->isEnabled()) {
+        const QByteArray sourceChecksum(contents.isEmpty()?
+                                            Checksum::fileHash(file)
+                                          : Checksum::hash(contents.constData(),
+                                                           contents.size()));
+        // Key uses the arguments, not the response file they are stored in
+        const QByteArray key(mObjectCache->key(compiler,
+                                               compilerArguments() + arguments,
+                                               sourceChecksum));
+        mObjectCacheKeys.insert(objectFile, key);
+        if (mObjectCache->restore(key, objectFile, depfileName(objectFile)))
+            return;
+
+        mCacheMisses.insert(objectFile, key);
+    }
+
+    // Compiled together with others, all with the precompiled header
+    if (isSmallSource(file, objectFile) and (isUsingPch or mPchHeader.isEmpty())) {
+        mSmallCompiles.append(PendingCompile { file, objectFile, contents,
+                                               QString() });
+        return;
+    }
+
+    arguments = commonArguments() + arguments;
+
+    MetaProcessPtr mp = MetaProcessPtr::create();
+    mp->file = objectFile;
+    mp->fileDependencies = findDependencies(file);
+    if (!mPchProcess.isNull() and isUsingPch)
+        mp->fileDependencies.append(mPchProcess);
+    addProcess(mp);
+
+    if (mFlags.pipe()) {
+        emit runProcess(compiler, arguments, mp, contents);
+    } else {
+        emit runProcess(compiler, arguments, mp, QByteArray());
+    }
+}
+
+/*!
+ * Returns true if \a file can be compiled together with other small sources,
+ * see compileSmallSources().
+ */
+bool Scope::isSmallSource(const QString &file, const QString &objectFile) const
+{
+    if (!mFlags.multiCompile or mFlags.pipe() or mCompiler.depfileFlags.isEmpty()
+            or mCompiler.multiDepfileFlags.isEmpty())
+        return false;
+
+    // Compiler names object files after sources when it compiles many of them
     const QFileInfo info(file);
-    const QString objectFile(info.baseName() + ".o");
+    if (info.suffix() == "c" or info.completeBaseName() + ".o" != objectFile)
+        return false;
+
+    // Compile time is known only if file has been compiled before
+    const qint64 compileTime = parsedFile(file).compileTime;
+    return (compileTime > 0 and compileTime < smallSourceTime);
+}
+
+/*!
+ * Compiles small sources queued by runCompiler() several at a time, with one
+ * compiler call, so that compiler startup is paid once per group instead of
+ * once per source. Groups are balanced by compile times from previous builds.
+ * There are never less groups than jobs (if there are enough sources), so
+ * that all jobs are kept busy.
+ *
+ * Objects compiled in groups are not stored in object cache: their cache keys
+ * come from single file compiler calls, while the group call has different
+ * arguments (include dirs of the whole group, no -o, other depfile flags).
+ */
+void Scope::compileSmallSources()
+{
+    if (mSmallCompiles.isEmpty())
+        return;
+
+    QVector<PendingCompile> sources(mSmallCompiles);
+    mSmallCompiles.clear();
+
+    // Source, expected compile time
+    QHash<QString, qint64> costs;
+    qint64 totalCost = 0;
+    for (const PendingCompile &entry : qAsConst(sources)) {
+        const qint64 cost = qMax<qint64>(parsedFile(entry.file).compileTime, 1);
+        costs.insert(entry.file, cost);
+        totalCost += cost;
+    }
+
+    const int count = qMin(sources.size(),
+                           qMax(int((totalCost + smallGroupTime - 1) / smallGroupTime),
+                                mFlags.jobs()));
+
+    // Most expensive sources first, each goes to the cheapest group
+    std::stable_sort(sources.begin(), sources.end(),
+                     [&costs](const PendingCompile &left, const PendingCompile &right) {
+        return costs.value(left.file) > costs.value(right.file);
+    });
+
+    QVector<qint64> loads(count, 0);
+    QVector<QVector<PendingCompile>> groups(count);
+    for (const PendingCompile &entry : qAsConst(sources)) {
+        const int cheapest = int(std::min_element(loads.constBegin(), loads.constEnd())
+                                 - loads.constBegin());
+        loads[cheapest] += costs.value(entry.file);
+        groups[cheapest].append(entry);
+    }
+
+    for (const auto &group : qAsConst(groups)) {
+        QStringList files;
+        for (const PendingCompile &entry : group)
+            files.append(entry.file);
+
+        QStringList arguments(commonArguments());
+        arguments.append(includeFlags(includeUsage(files, mPchHeaders)));
+        if (!mPchHeader.isEmpty()) {
+            arguments.append({ "-include", mPchHeader });
+        }
+        // No -o: each object is written next to its depfile, named after
+        // the source
+        arguments.append(mCompiler.multiDepfileFlags);
+
+        MetaProcessPtr mp = MetaProcessPtr::create();
+        for (const PendingCompile &entry : group) {
+            arguments.append(entry.file);
+            mp->outputs.append(entry.objectFile);
+            mp->fileDependencies.append(findDependencies(entry.file));
+            mCacheMisses.remove(entry.objectFile);
+            mObjectCacheKeys.remove(entry.objectFile);
+        }
+        mp->file = mp->outputs.first();
+        if (!mPchProcess.isNull())
+            mp->fileDependencies.append(mPchProcess);
+        addProcess(mp);
+
+        qDebug() << "Compiling together:" << mp->outputs;
+        emit runProcess(compilerCommand(group.first().file), arguments, mp,
+                        QByteArray());
+    }
+}
 
+/*!
+ * Returns the compiler which should be used for \a file (C or C++).
+ */
+QString Scope::compilerCommand(const QString &file) const
+{
     // TODO: add support for non-android cross compilation...
     const QString compilerPath(mFlags.crossCompile?
         QString(mFlags.androidNdkPath + "/toolchains/arm-linux-androideabi-4.9/prebuilt/linux-x86_64/bin/")
         : "");
 
     // TODO: improve compiler detection!
-    const QString compiler(info.suffix() == "c"?
+    return (QFileInfo(file).suffix() == "c"?
         compilerPath + mCompiler.toolPrefix + mCompiler.ccompiler
         : compilerPath + mCompiler.toolPrefix + mCompiler.compiler);
+}
+
+/*!
+ * Returns compiler arguments common to all files compiled in this scope:
+ * flags, defines and include paths.
+ */
+QStringList Scope::compilerArguments() const
+{
+    if (mHasCompilerArguments)
+        return mCompilerArguments;
 
     if (!qtModules().isEmpty()) {
         if (mFlags.qtDir.isEmpty()) {
@@ -317,7 +982,6 @@ QString Scope::compile(const QString &file, const FileInfo &fileInfo)
         }
     }
 
-    //qInfo() << "Compiling:" << file << "into:" << objectFile;
     QStringList arguments(mCompiler.flags);
 
     if (mFlags.debugBuild) {
@@ -349,32 +1013,295 @@ QString Scope::compile(const QString &file, const FileInfo &fileInfo)
     arguments.append(qtDefines());
     arguments.append(qtIncludes());
     arguments.append(customIncludeFlags());
-    arguments.append({ "-o", objectFile });
-    if (mFlags.pipe()) {
-        arguments.append({ "-x", "c++", "-" });
-    } else {
-        arguments.append(file);
-    }
-
-    MetaProcessPtr mp = MetaProcessPtr::create();
-    mp->file = objectFile;
-    mp->fileDependencies = findDependencies(file);
-    mProcessQueue.append(mp);
 
-    if (mFlags.pipe()) {
-        emit runProcess(compiler, arguments, mp, fileInfo.contents);
-    } else {
-        emit runProcess(compiler, arguments, mp, QByteArray());
+    // Keep checkout location out of objects (debug info, __FILE__), so that
+    // they are the same in every checkout. Only needed for object cache, and
+    // not supported by older compilers (GCC < 8)
+    if (!mObjectCache.isNull() and mObjectCache->isEnabled()) {
+        const QString sourceRoot(QDir::currentPath());
+        for (const QString &flag : qAsConst(mCompiler.prefixMapFlags)) {
+            arguments.append(flag.arg(sourceRoot, "."));
+        }
     }
-    return objectFile;
+
+    mCompilerArguments = arguments;
+    mHasCompilerArguments = true;
+    return arguments;
 }
 
-void Scope::link()
+/*!
+ * Returns compilerArguments() in the form they are passed to the compiler.
+ * If the compiler supports response files, the arguments are written to one
+ * (once per scope and configuration) and only the response file is passed.
+ * This keeps command lines short, even with many include paths.
+ *
+ * Response file name contains a checksum of its contents, so processes which
+ * are already queued keep reading the arguments they were scheduled with.
+ */
+QStringList Scope::commonArguments()
 {
-    if (mIsError)
-        return;
+    if (mCompiler.responseFileFlag.isEmpty())
+        return compilerArguments();
+
+    if (mResponseFile.isEmpty()) {
+        QByteArray contents;
+        const QStringList arguments(compilerArguments());
+        for (const QString &argument : arguments) {
+            contents.append(responseFileArgument(argument));
+            contents.append('\n');
+        }
 
-    QStringList objectFiles;
+        const QString checksum(Checksum::hash(contents.constData(),
+                                              contents.size()).toHex().left(16));
+        const QString responseFile(targetName() + "_" + checksum
+                                   + responseFileSuffix);
+        if (!QFileInfo::exists(responseFile)) {
+            QSaveFile file(responseFile);
+            if (!file.open(QFile::WriteOnly) or file.write(contents) != contents.size()
+                    or !file.commit()) {
+                qWarning() << "Could not write response file:" << responseFile;
+                return arguments;
+            }
+        }
+
+        mResponseFile = responseFile;
+    }
+
+    return { mCompiler.responseFileFlag.arg(mResponseFile) };
+}
+
+/*!
+ * Makes compilerArguments() compute the arguments again. Has to be called
+ * whenever something they are made of (flags, defines, includes, Qt modules)
+ * changes.
+ */
+void Scope::resetCompilerArguments()
+{
+    mCompilerArguments.clear();
+    mHasCompilerArguments = false;
+    mResponseFile.clear();
+}
+
+/*!
+ * Returns include flags specific to a compilation with include \a usage (see
+ * includeUsage()): include paths of scopes this one depends on, if some
+ * include comes from them, and auto include dirs in which includes are found.
+ *
+ * Flags depend only on scan results of the files and their includes, never
+ * on how far parsing has got. Thanks to that, a file is compiled with the same
+ * arguments in every build, which keeps object cache keys stable. Files which
+ * use other scopes are compiled only once these scopes are parsed, see
+ * compileReady().
+ */
+QStringList Scope::includeFlags(const IncludeUsage &usage) const
+{
+    QStringList flags;
+    if (usage.usesScopes) {
+        const QStringList paths(scopeIncludePaths());
+        for (const QString &path : paths) {
+            const QString flag("-I" + mRelativePath + "/" + path);
+            if (!mCustomIncludeFlags.contains(flag))
+                flags.append(flag);
+        }
+    }
+
+    // Keep the order of the scan, so headers are found in the same place as
+    // with all directories passed
+    for (const QString &dir : qAsConst(mAutoIncludes)) {
+        if (usage.autoIncludes.contains(dir))
+            flags.append("-I" + mRelativePath + "/" + dir);
+    }
+    return flags;
+}
+
+/*!
+ * Returns include dirs needed by \a files, all files they include
+ * (according to their last scan) and \a libraryIncludes. Also tells if any of
+ * these files sets macros before its includes.
+ *
+ * Includes which are not files of this scope, and library includes found in
+ * scopes this one depends on, mark the usage as using scopes.
+ */
+Scope::IncludeUsage Scope::includeUsage(const QStringList &files,
+                                        const QStringList &libraryIncludes) const
+{
+    IncludeUsage result;
+    const auto addLibraryInclude = [this, &result](const QString &include) {
+        const QString dir(libraryIncludeDir(include));
+        if (!dir.isEmpty())
+            result.autoIncludes.insert(dir);
+        else if (isScopeHeader(include))
+            result.usesScopes = true;
+    };
+
+    for (const QString &include : libraryIncludes)
+        addLibraryInclude(include);
+
+    QSet<QString> visited;
+    QStringList stack;
+    for (const QString &file : files)
+        stack.append(ParsedFileSet::key(file));
+
+    while (!stack.isEmpty()) {
+        const QString key(stack.takeLast());
+        if (visited.contains(key))
+            continue;
+        visited.insert(key);
+
+        const auto it = mParsedFiles.constFind(mFileKeys.value(key));
+        if (it == mParsedFiles.constEnd())
+            continue;
+        const FileInfo *info = &it.value();
+
+        bool hasDefine = false;
+        for (const auto &event : info->events) {
+            if (event.type == ParseResult::Define) {
+                hasDefine = true;
+            } else if (event.type == ParseResult::LibraryInclude) {
+                result.definesMacros = (result.definesMacros or hasDefine);
+                addLibraryInclude(event.value);
+            } else if (event.type == ParseResult::Include) {
+                result.definesMacros = (result.definesMacros or hasDefine);
+                const QString includeKey(ParsedFileSet::key(event.value));
+                const QString path(mFileKeys.value(includeKey));
+                if (path.isEmpty()) {
+                    // Skipped as a subproject file, or not found at all
+                    result.usesScopes = true;
+                    continue;
+                }
+
+                const QString dir(autoIncludeDir(path, event.value));
+                if (!dir.isEmpty())
+                    result.autoIncludes.insert(dir);
+                stack.append(includeKey);
+            }
+        }
+    }
+
+    return result;
+}
+
+/*!
+ * Returns auto include dir through which \a include was found at \a path,
+ * or an empty string if it was found elsewhere.
+ */
+QString Scope::autoIncludeDir(const QString &path, const QString &include) const
+{
+    const QString suffix("/" + include);
+    const QString prefix(mRelativePath + "/");
+    if (!path.endsWith(suffix) or !path.startsWith(prefix))
+        return QString();
+
+    const QString dir(path.mid(prefix.size(),
+                               path.size() - prefix.size() - suffix.size()));
+    return mAutoIncludes.contains(dir)? dir : QString();
+}
+
+/*!
+ * Returns auto include dir in which library \a include (like <foo/bar.h>)
+ * is found, or an empty string if it is not in any (system headers).
+ */
+QString Scope::libraryIncludeDir(const QString &include) const
+{
+    const auto it = mLibraryIncludeDirs.constFind(include);
+    if (it != mLibraryIncludeDirs.constEnd())
+        return it.value();
+
+    QString result;
+    for (const QString &dir : qAsConst(mAutoIncludes)) {
+        if (fileExists(mRelativePath + "/" + dir + "/" + include)) {
+            result = dir;
+            break;
+        }
+    }
+
+    mLibraryIncludeDirs.insert(include, result);
+    return result;
+}
+
+/*!
+ * Returns true if library \a include (like <foo/bar.h>) is found anywhere
+ * in the tree of a scope this one depends on. Checked against the whole tree,
+ * because include paths of that scope may not be known yet.
+ */
+bool Scope::isScopeHeader(const QString &include) const
+{
+    if (mScopeDependencies.isEmpty() or mFileIndex.isNull())
+        return false;
+
+    const auto it = mScopeHeaders.constFind(include);
+    if (it != mScopeHeaders.constEnd())
+        return it.value();
+
+    bool result = false;
+    for (const auto &scope : qAsConst(mScopeDependencies)) {
+        if (mFileIndex->containsUnder(scope->relativePath(), include)) {
+            result = true;
+            break;
+        }
+    }
+
+    mScopeHeaders.insert(include, result);
+    return result;
+}
+
+/*!
+ * Runs all compilations which were postponed while parsing.
+ */
+void Scope::compilePending()
+{
+    const QVector<PendingCompile> pending(mPendingCompiles);
+    mPendingCompiles.clear();
+
+    for (const PendingCompile &entry : pending) {
+        if (mIsError)
+            return;
+
+        runCompiler(entry.file, entry.objectFile, entry.contents);
+    }
+
+    compileSmallSources();
+}
+
+/*!
+ * Runs postponed compilations whose sources are ready: the source and all files
+ * it (transitively) includes have been parsed. The rest of the tree can still
+ * be scanned in the meantime.
+ *
+ * Sources which include headers of scopes this one depends on wait until these
+ * scopes are parsed, because they can still add include paths (see
+ * includeFlags()). Other sources are compiled while subprojects are being
+ * parsed.
+ */
+void Scope::compileReady()
+{
+    const bool isWaitingForScopes = this->isWaitingForScopes();
+    const QVector<PendingCompile> pending(mPendingCompiles);
+    mPendingCompiles.clear();
+
+    for (const PendingCompile &entry : pending) {
+        if (mIsError)
+            return;
+
+        QSet<QString> visited;
+        if (isClosureParsed(entry.owner, visited)
+                and !(isWaitingForScopes
+                      and includeUsage(QStringList { entry.file }).usesScopes)) {
+            runCompiler(entry.file, entry.objectFile, entry.contents);
+        } else {
+            mPendingCompiles.append(entry);
+        }
+    }
+
+    compileSmallSources();
+}
+
+/*!
+ * Returns all object files which are linked into this scope's target.
+ */
+QStringList Scope::objectFiles() const
+{
+    QStringList objectFiles;
     const auto parsed = parsedFiles();
     for (const auto &info : parsed) {
         if (!info.objectFile.isEmpty())
@@ -382,8 +1309,329 @@ void Scope::link()
         if (!info.generatedObjectFile.isEmpty())
             objectFiles.append(info.generatedObjectFile);
     }
+    // Sources in the same unity batch share an object file
+    objectFiles.removeDuplicates();
+    return objectFiles;
+}
+
+/*!
+ * Returns path to the main file produced by linking this scope.
+ */
+QString Scope::targetFile() const
+{
+    if (targetType() == Tags::targetLib) {
+        if (targetLibType() == Tags::targetLibStatic) {
+            return mCompiler.libraryPrefix + targetName()
+                    + mCompiler.staticLibrarySuffix;
+        }
+
+        return mFlags.prefix() + "/" + mCompiler.libraryPrefix + targetName()
+                + mCompiler.librarySuffix + "." + mVersion.toString();
+    }
+
+    return mFlags.prefix() + "/" + targetName();
+}
+
+/*!
+ * Returns a checksum of everything that goes into linking: linker and its
+ * flags, target settings, libraries, metadata of all object files and of
+ * targets of scopes this one depends on.
+ */
+QByteArray Scope::linkSignature() const
+{
+    QStringList inputs {
+        mCompiler.toolPrefix, mCompiler.linker, mCompiler.staticArchiver,
+        targetName(), targetType(), targetLibType(), mVersion.toString(),
+        mFlags.prefix(), QString::number(mFlags.crossCompile)
+    };
+    inputs.append(mCompiler.linkerFlags);
+    inputs.append(qtLibs());
+    inputs.append(customLibs());
+
+    QStringList files(objectFiles());
+    files.sort();
+    for (const auto &scope : qAsConst(mScopeDependencies)) {
+        files.append(scope->targetFile());
+    }
+
+    for (const QString &file : qAsConst(files)) {
+        const auto stat = Gibs::fileStat(file);
+        inputs.append(file);
+        inputs.append(QString::number(stat.inode));
+        inputs.append(QString::number(stat.size));
+        inputs.append(QString::number(stat.modified));
+    }
+
+    const QByteArray data(inputs.join('\n').toUtf8());
+    return Checksum::hash(data.constData(), data.size());
+}
+
+/*!
+ * Stores link signature of current build outputs. Should be called after all
+ * jobs are done.
+ */
+void Scope::updateLinkSignature()
+{
+    if (mHasStarted)
+        mLinkSignature = linkSignature();
+}
+
+/*!
+ * Returns library headers (like vector) which are included, directly or
+ * through local headers, by at least half of C++ source files in this scope,
+ * and umbrella headers (like QtCore) of Qt modules whose headers are included.
+ * Include statistics come from the last scan of each file.
+ */
+QStringList Scope::pchHeaders() const
+{
+    // File name, parsed file. Include events only contain file names
+    QHash<QString, const FileInfo *> files;
+    for (const FileInfo &info : mParsedFiles) {
+        files.insert(ParsedFileSet::key(info.path), &info);
+    }
+
+    // Header, number of sources which include it
+    QHash<QString, int> counts;
+    int sources = 0;
+    for (const FileInfo &info : mParsedFiles) {
+        if (info.type != FileInfo::Cpp or info.objectFile.isEmpty()
+                or QFileInfo(info.path).suffix() == "c")
+            continue;
+
+        ++sources;
+        QSet<QString> headers;
+        QSet<QString> visited;
+        QStringList stack { ParsedFileSet::key(info.path) };
+        while (!stack.isEmpty()) {
+            const QString key(stack.takeLast());
+            if (visited.contains(key))
+                continue;
+            visited.insert(key);
+
+            const FileInfo *file = files.value(key);
+            if (file == nullptr)
+                continue;
+
+            for (const auto &event : file->events) {
+                if (event.type == ParseResult::LibraryInclude) {
+                    headers.insert(event.value);
+                } else if (event.type == ParseResult::Include) {
+                    stack.append(ParsedFileSet::key(event.value));
+                }
+            }
+        }
+
+        for (const QString &header : qAsConst(headers)) {
+            ++counts[header];
+        }
+    }
+
+    QStringList result;
+    if (sources < minPchSources)
+        return result;
+
+    // Qt headers are replaced by umbrella headers of their modules (like
+    // QtCore), so that sources which include less common Qt headers benefit
+    // from the precompiled header, too
+    QStringList umbrellas;
+    for (const QString &module : qAsConst(mQtModules)) {
+        const QString umbrella("Qt" + qtModuleName(module));
+        const QString dir(mFlags.qtDir + "/include/" + umbrella + "/");
+        for (auto it = counts.begin(); it != counts.end(); ) {
+            if (it.key().startsWith(umbrella + "/") or QFileInfo::exists(dir + it.key())) {
+                if (!umbrellas.contains(umbrella))
+                    umbrellas.append(umbrella);
+                it = counts.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Headers of other scopes need their include paths, which can still
+    // change while the precompiled header is built
+    for (auto it = counts.constBegin(); it != counts.constEnd(); ++it) {
+        if (it.value() * 2 >= sources and !isScopeHeader(it.key()))
+            result.append(it.key());
+    }
+
+    result.sort();
+    return umbrellas + result;
+}
+
+QString Scope::pchFile() const
+{
+    return mPchHeader + mCompiler.pchSuffix;
+}
+
+/*!
+ * Returns compiler arguments used to build precompiled header, in addition to
+ * common compilerArguments(). These have to be the same as for regular
+ * compilations, otherwise the compiler ignores the precompiled header.
+ */
+QStringList Scope::pchArguments() const
+{
+    QStringList arguments(includeFlags(includeUsage(QStringList(), mPchHeaders)));
+    arguments.append(mCompiler.pchFlags);
+    for (const QString &flag : qAsConst(mCompiler.depfileFlags)) {
+        arguments.append(flag.contains("%1")? flag.arg(depfileName(mPchHeader))
+                                            : flag);
+    }
+    arguments.append({ "-o", pchFile(), mPchHeader });
+    return arguments;
+}
+
+/*!
+ * Returns checksum of everything precompiled header is made of: compiler,
+ * its arguments and all headers it has been built from (as reported by the
+ * compiler in the depfile).
+ */
+QByteArray Scope::pchSignature() const
+{
+    QStringList inputs { compilerCommand(mPchHeader) };
+    inputs.append(compilerArguments());
+    inputs.append(pchArguments());
+
+    const QStringList dependencies(Gibs::readDepfile(depfileName(mPchHeader)));
+    for (const QString &dependency : dependencies) {
+        const auto stat = Gibs::fileStat(dependency);
+        inputs.append(dependency);
+        inputs.append(QString::number(stat.inode));
+        inputs.append(QString::number(stat.size));
+        inputs.append(QString::number(stat.modified));
+    }
+
+    const QByteArray data(inputs.join('\n').toUtf8());
+    return Checksum::hash(data.constData(), data.size());
+}
+
+/*!
+ * Generates a header including the most commonly used library headers and
+ * schedules building a precompiled header from it, unless it is up to date.
+ * All C++ compilations in this scope will include it.
+ *
+ * Header list is based on scan results from previous build, so nothing is
+ * precompiled in the very first build.
+ */
+void Scope::preparePch()
+{
+    mPchHeader.clear();
+    mPchHeaders.clear();
+    mPchProcess.clear();
 
-    // TODO: add dependent scopes (from other subprojects)
+    if (!mFlags.autoPch or mCompiler.pchSuffix.isEmpty())
+        return;
+
+    const QStringList headers(pchHeaders());
+    if (headers.isEmpty())
+        return;
+
+    QByteArray contents("// Generated by gibs. Library headers included by most sources\n");
+    for (const QString &header : headers) {
+        contents.append("#include <" + header.toUtf8() + ">\n");
+    }
+
+    // File is rewritten only when its contents change, all objects depend on it
+    const QString header(targetName() + pchHeaderSuffix);
+    if (Checksum::fileHash(header) != Checksum::hash(contents.constData(),
+                                                     contents.size())) {
+        QSaveFile file(header);
+        if (!file.open(QFile::WriteOnly) or file.write(contents) != contents.size()
+                or !file.commit()) {
+            qWarning() << "Could not write precompiled header:" << header;
+            return;
+        }
+    }
+
+    mPchHeader = header;
+    mPchHeaders = headers;
+    if (QFileInfo::exists(pchFile()) and pchSignature() == mPchSignature)
+        return;
+
+    qInfo() << "Precompiling" << headers.size() << "headers into:" << pchFile();
+    MetaProcessPtr mp = MetaProcessPtr::create();
+    mp->file = pchFile();
+    addProcess(mp);
+    mPchProcess = mp;
+    emit runProcess(compilerCommand(mPchHeader), commonArguments() + pchArguments(),
+                    mp, QByteArray());
+}
+
+/*!
+ * Removes response files of this target written with other compiler
+ * arguments (in previous builds, or before arguments changed in this one).
+ * Should be called after all jobs are done.
+ */
+void Scope::removeStaleResponseFiles()
+{
+    // Nothing has been compiled, current arguments are not known
+    if (mResponseFile.isEmpty())
+        return;
+
+    const QStringList responseFiles(QDir::current().entryList(
+        { targetName() + responseFileChecksumPattern + responseFileSuffix },
+        QDir::Files));
+    for (const QString &responseFile : responseFiles) {
+        if (responseFile != mResponseFile)
+            Gibs::removeFile(responseFile);
+    }
+}
+
+/*!
+ * Returns checksum of settings which scan results depend on: scanner version,
+ * whether whole files are scanned and features (which decide which #ifdef
+ * blocks are read).
+ */
+QByteArray Scope::scanSignature() const
+{
+    QStringList features;
+    for (const auto &feature : qAsConst(mFeatures)) {
+        features.append(feature.define + "=" + (feature.enabled? "1" : "0"));
+    }
+    features.sort();
+
+    const QStringList inputs {
+        QString::number(scanVersion),
+        mFlags.parseWholeFiles? "1" : "0",
+        features.join(',')
+    };
+    const QByteArray data(inputs.join('\n').toUtf8());
+    return Checksum::hash(data.constData(), data.size());
+}
+
+/*!
+ * Stores signature of precompiled header inputs. Should be called after all
+ * jobs are done.
+ */
+void Scope::updatePchSignature()
+{
+    if (mHasStarted and !mPchHeader.isEmpty() and QFileInfo::exists(pchFile()))
+        mPchSignature = pchSignature();
+}
+
+/*!
+ * Schedules linking of the target. Returns false if linking is not necessary:
+ * nothing has been rebuilt in this scope nor in scopes it depends on, and
+ * link signature has not changed since last build.
+ */
+bool Scope::link()
+{
+    if (mIsError)
+        return false;
+
+    bool isUpToDate = mProcessQueue.isEmpty() and !mLinkSignature.isEmpty()
+            and QFileInfo::exists(targetFile());
+    for (const auto &scope : qAsConst(mScopeDependencies)) {
+        if (!scope->mProcessQueue.isEmpty())
+            isUpToDate = false;
+    }
+
+    if (isUpToDate and linkSignature() == mLinkSignature) {
+        qInfo() << "Target is up to date, skipping linking:" << targetName();
+        return false;
+    }
+
+    QStringList objectFiles(this->objectFiles());
 
     qInfo() << "Linking:" << objectFiles;
     const QString linkerPath(mFlags.crossCompile?
@@ -435,11 +1683,13 @@ void Scope::link()
             } else if (targetLibType() == Tags::targetLibStatic) {
                 // Run ar to create the static library file
                 MetaProcessPtr mp = MetaProcessPtr::create();
+                mp->type = MetaProcess::Archive;
                 mp->file = mCompiler.libraryPrefix + targetName()
                         + mCompiler.staticLibrarySuffix;
+                // Archive holds own objects only, it does not wait for
+                // other scopes
                 mp->fileDependencies = findAllDependencies();
-                mp->scopeDepenencies = mScopeDependencyIds;
-                mProcessQueue.append(mp);
+                addProcess(mp);
                 emit runProcess(linkerPath + mCompiler.toolPrefix
                                 + mCompiler.staticArchiver,
                                 QStringList {
@@ -447,7 +1697,7 @@ void Scope::link()
                                     mp->file,
                                     targetName() + ".o"
                                 }, mp, QByteArray());
-                return;
+                return true;
             }
         } else {
             arguments.append({ "-o", mFlags.prefix() + "/" + targetName() });
@@ -468,21 +1718,22 @@ void Scope::link()
     arguments.append(customLibs());
 
     MetaProcessPtr mp = MetaProcessPtr::create();
+    mp->type = MetaProcess::Link;
     mp->file = targetName();
     mp->fileDependencies = findAllDependencies();
     mp->scopeDepenencies = mScopeDependencyIds;
-    mProcessQueue.append(mp);
+    addProcess(mp);
     emit runProcess(compiler, arguments, mp, QByteArray());
 
     if (targetType() == Tags::targetLib) {
         if (targetLibType() == Tags::targetLibDynamic) {
             // Create unversioned symlink to library
             MetaProcessPtr mp = MetaProcessPtr::create();
+            mp->type = MetaProcess::Link;
             mp->file = targetName() + mCompiler.librarySuffix + "."
                     + QString::number(mVersion.majorVersion());
             mp->fileDependencies = findAllDependencies();
-            mp->scopeDepenencies = mScopeDependencyIds;
-            mProcessQueue.append(mp);
+            addProcess(mp);
             emit runProcess("ln", QStringList {
                 "-s",
                 mFlags.prefix() + "/" + mCompiler.libraryPrefix
@@ -495,6 +1746,8 @@ void Scope::link()
             }, mp, QByteArray());
         }
     }
+
+    return true;
 }
 
 void Scope::deploy()
@@ -503,6 +1756,7 @@ void Scope::deploy()
     QStringList arguments;
 
     MetaProcessPtr mp = MetaProcessPtr::create();
+    mp->type = MetaProcess::Deploy;
     mp->fileDependencies = findAllDependencies();
     mp->scopeDepenencies = mScopeDependencyIds;
 
@@ -548,69 +1802,260 @@ void Scope::deploy()
         });
         arguments.append(mDeployer.flags);
 
-        qputenv("JAVA_HOME", qPrintable(mFlags.jdkPath));
+        qputenv("JAVA_HOME", qPrintable(mFlags.jdkPath));
+    }
+
+    mp->file = targetName() + "." + suffix;
+    addProcess(mp);
+    emit runProcess(mDeployer.executable, arguments, mp, QByteArray());
+}
+
+/*!
+ * Queues \a file for parsing. It will be scanned in the next wave.
+ */
+void Scope::parseFile(const QString &file)
+{
+    mParseQueue.append(file);
+    mUnmerged.insert(ParsedFileSet::key(file));
+}
+
+/*!
+ * Parses all files waiting in the parse queue.
+ *
+ * Files are scanned in waves, on the global thread pool: each wave consists of
+ * the files requested while the previous wave was merged. Merging (applying
+ * gibs commands, resolving includes, scheduling compilation) happens in this
+ * thread, in the order in which files were requested. Thanks to that, the
+ * results do not depend on thread scheduling, and cache and command lines are
+ * identical between runs.
+ *
+ * Scanning does not block the event loop, so compilers started for files
+ * which are ready run while the rest of the tree is being scanned.
+ */
+void Scope::parsePending()
+{
+    if (mIsParsing)
+        return;
+
+    if (mParseQueue.isEmpty() or mIsError) {
+        finishParsing();
+        return;
+    }
+
+    mIsParsing = true;
+    startWave();
+}
+
+void Scope::startWave()
+{
+    const QStringList wave(mParseQueue);
+    mParseQueue.clear();
+
+    // Cached scans are only valid for the same scan settings
+    const QByteArray signature(scanSignature());
+    if (signature != mScanSignature) {
+        mScanCache.clear();
+        mScanSignature = signature;
+    }
+
+    FileScanner scanner;
+    scanner.parseWholeFiles = mFlags.parseWholeFiles;
+    scanner.features = mFeatures;
+    scanner.cached = mScanCache;
+    scanner.fileIndex = mFileIndex;
+    mParseWatcher.setFuture(QtConcurrent::mapped(wave, scanner));
+}
+
+/*!
+ * Link and deploy steps need the full list of object files, so they are
+ * scheduled once parsing of this scope, and of all scopes it depends on, is
+ * done.
+ */
+void Scope::finishParsing()
+{
+    if (mHasFinishedParsing)
+        return;
+
+    for (const auto &scope : qAsConst(mScopeDependencies)) {
+        if (scope->isParsing())
+            return;
+    }
+
+    compilePending();
+    compileUnity();
+    mHasFinishedParsing = true;
+
+    // Parsing done, link it!
+    const bool isLinking = link();
+
+    // Linking is scheduled, deploy it!
+    if (isLinking and mDeploy and targetType() == Tags::targetApp) {
+        // Use the deployment tool!
+        deploy();
+    }
+
+    emit parsingFinished(id());
+    checkFinished();
+}
+
+/*!
+ * Emits finished() once, when isFinished() becomes true.
+ */
+void Scope::checkFinished()
+{
+    if (mHasFinished or !isFinished())
+        return;
+
+    mHasFinished = true;
+    emit finished(id());
+}
+
+/*!
+ * Returns true if \a file and all files it includes are parsed and merged
+ * into this scope. \a visited protects from include cycles.
+ */
+bool Scope::isClosureParsed(const QString &file, QSet<QString> &visited) const
+{
+    const QString key(ParsedFileSet::key(file));
+    if (visited.contains(key))
+        return true;
+    visited.insert(key);
+
+    if (mUnmerged.contains(key))
+        return false;
+
+    const QStringList includes(mIncludeGraph.value(key));
+    for (const QString &include : includes) {
+        if (!isClosureParsed(include, visited))
+            return false;
     }
 
-    mp->file = targetName() + "." + suffix;
-    mProcessQueue.append(mp);
-    emit runProcess(mDeployer.executable, arguments, mp, QByteArray());
+    return true;
 }
 
-void Scope::parseFile(const QString &file)
+/*!
+ * Returns true if any of the scopes this one depends on is still parsing.
+ */
+bool Scope::isWaitingForScopes() const
 {
-    FileParser parser(file, mFlags.parseWholeFiles, this);
-    connect(&parser, &FileParser::error, this, &Scope::error);
-    connect(&parser, &FileParser::parsed, this, &Scope::onParsed);
-    connect(&parser, &FileParser::parseRequest, this, &Scope::onParseRequest);
-    connect(&parser, &FileParser::runMoc, this, &Scope::onRunMoc);
-    connect(&parser, &FileParser::runTool, this, &Scope::onRunTool);
-    connect(&parser, &FileParser::subproject, this, &Scope::subproject);
-    parser.parse();
+    for (const auto &scope : qAsConst(mScopeDependencies)) {
+        if (scope->isParsing())
+            return true;
+    }
+
+    return false;
 }
 
 /*!
  * Checks if \a file has changed since last compilation. Returns true if it has,
- * or if it is not in cache.
+ * or if it is not in cache. \a stat is current metadata of \a file.
+ *
+ * Inode, size and modification time are compared first, that is cheap. Only
+ * if they differ, file contents are hashed and compared with cached checksum
+ * (unless \a isQuickMode is on). If contents are the same (file was touched,
+ * or checked out again), metadata in cache is refreshed and the file is not
+ * rebuilt.
  *
  * If returns true, \a file will be recompiled.
  */
-bool Scope::isFileDirty(const QString &file, const bool isQuickMode) const
+bool Scope::isFileDirty(const QString &file, const Gibs::FileStat &stat,
+                        const bool isQuickMode)
 {
-    const QFileInfo realFile(file);
-
-    if (!realFile.exists()) {
+    if (!stat.isValid()) {
         qInfo() << "File has vanished!" << file;
+        return true;
     }
 
-    const FileInfo cachedFile(parsedFile(file));
+    FileInfo cachedFile(parsedFile(file));
+
+    if (stat == cachedFile.stat) {
+        return false;
+    }
 
-    if (realFile.created() != cachedFile.dateCreated) {
-        qDebug() << "Different creation date. Recompiling."
-                 << file << realFile.created() << cachedFile.dateCreated;
+    if (isQuickMode) {
+        qDebug() << "Different file metadata. Recompiling." << file;
         return true;
     }
 
-    if (realFile.lastModified() != cachedFile.dateModified) {
-        qDebug() << "Different modification date. Recompiling."
-                 << file << realFile.lastModified() << cachedFile.dateModified;
+    if (cachedFile.stat.isValid() and stat.size != cachedFile.stat.size) {
+        qDebug() << "Different size. Recompiling."
+                 << file << stat.size << cachedFile.stat.size;
         return true;
     }
 
-    if (!isQuickMode) {
-        // Deep verification is off - for now
-//        QFile fileData(file);
-//        fileData.open(QFile::ReadOnly | QFile::Text);
-//        const auto checksum = QCryptographicHash::hash(fileData.readAll(), QCryptographicHash::Sha1);
-//        if (checksum != cachedFile.checksum) {
-//            qDebug() << "Different checksum. Recompiling."
-//                     << file << checksum << cachedFile.checksum;
-//            return true;
-//        }
+    const auto checksum = Checksum::fileHash(file);
+    if (checksum != cachedFile.checksum) {
+        qDebug() << "Different checksum. Recompiling."
+                 << file << checksum.toHex() << cachedFile.checksum.toHex();
+        return true;
     }
 
+    // Contents are the same - remember new metadata, so that next check is
+    // quick again
+    const QFileInfo realFile(file);
+    cachedFile.stat = stat;
+    cachedFile.dateModified = realFile.lastModified();
+    cachedFile.dateCreated = realFile.created();
+    insertParsedFile(cachedFile);
     return false;
 }
 
+/*!
+ * Returns parsed files whose metadata differs from the cache. Each file is
+ * stat()ed only once, results are stored in \a stats.
+ */
+QStringList Scope::findChangedFiles(QHash<QString, Gibs::FileStat> &stats) const
+{
+    QStringList result;
+    for (const FileInfo &info : mParsedFiles) {
+        const Gibs::FileStat stat(Gibs::fileStat(info.path));
+        stats.insert(info.path, stat);
+        if (!(stat == info.stat))
+            result.append(info.path);
+    }
+
+    result.sort();
+    return result;
+}
+
+/*!
+ * Returns paths of source files which need to be recompiled, because one of
+ * their dependencies (according to the compiler's depfiles) has changed.
+ *
+ * Only dependencies are checked, then the reverse index leads straight to the
+ * affected source files. Files already in \a stats are not stat()ed again.
+ */
+QStringList Scope::findAffectedFiles(QHash<QString, Gibs::FileStat> &stats) const
+{
+    QStringList result;
+    for (auto it = mDependencyStats.constBegin();
+         it != mDependencyStats.constEnd(); ++it) {
+        auto stat = stats.find(it.key());
+        if (stat == stats.end())
+            stat = stats.insert(it.key(), Gibs::fileStat(it.key()));
+        if (stat.value() == it.value())
+            continue;
+
+        const QStringList dependents(mDependents.value(it.key()));
+        qDebug() << "Dependency changed:" << it.key() << "affects:" << dependents;
+        result.append(dependents);
+    }
+
+    // Keep compilation order stable between runs
+    result.removeDuplicates();
+    result.sort();
+    return result;
+}
+
+/*!
+ * Returns the name of depfile written by the compiler alongside
+ * \a objectFile.
+ */
+QString Scope::depfileName(const QString &objectFile)
+{
+    return QFileInfo(objectFile).completeBaseName() + ".d";
+}
+
 void Scope::onParsed(const QString &file, const QString &source,
                      const QByteArray &checksum, const QDateTime &modified,
                      const QDateTime &created,
@@ -627,7 +2072,7 @@ void Scope::onParsed(const QString &file, const QString &source,
 
     // Compile source file, if present
     if (!source.isEmpty() and source == file) {
-        info.objectFile = compile(source, info);
+        info.objectFile = compileSource(source, info);
     }
 
     // TODO: switch to pointers and modify in-place?
@@ -640,6 +2085,15 @@ void Scope::onParseRequest(const QString &file, const bool force)
     if (mIsError)
         return;
 
+    // Remember who includes whom, compilation waits for the whole tree
+    if (!force and !mCurrentFile.isEmpty()) {
+        const QString includer(ParsedFileSet::key(mCurrentFile));
+        const QString include(ParsedFileSet::key(file));
+        QStringList &includes = mIncludeGraph[includer];
+        if (!includes.contains(include))
+            includes.append(include);
+    }
+
     // Skip files which we have parsed already
     if (!force and isParsed(file)) {
         return;
@@ -653,18 +2107,15 @@ void Scope::onParseRequest(const QString &file, const bool force)
     }
 
     // Find file in include dirs
-    const QString selectedFile(findFile(file));
+    QString includeDir;
+    const QString selectedFile(findFile(file, includePaths(), &includeDir));
+    useAutoInclude(includeDir);
 
     if (selectedFile.isEmpty()) {
         qWarning() << "Could not find file:" << file;
         return;
     }
 
-    // Skip again, because name could have changed
-    if (!force and isParsed(selectedFile)) {
-        return;
-    }
-
     // Skip files from subprojects
     // TODO: features are fine
     if (isFromSubproject(selectedFile)) {
@@ -672,13 +2123,99 @@ void Scope::onParseRequest(const QString &file, const bool force)
         return;
     }
 
-    // Prevent file from being parsed twice
-    FileInfo info;
-    info.path = selectedFile;
-    insertParsedFile(info);
+    // Skip again, because name could have changed. This also marks the file
+    // as parsed, preventing it from being parsed twice
+    if (mParsedSet.insert(selectedFile) == false) {
+        if (!force or mParseQueue.contains(selectedFile)) {
+            return;
+        }
+    }
+
     parseFile(selectedFile);
 }
 
+/*!
+ * Merges a wave of scanned files, in the order in which they were requested,
+ * then compiles whatever became ready and starts the next wave.
+ */
+void Scope::onWaveScanned()
+{
+    const QList<ParseResult> results(mParseWatcher.future().results());
+
+    for (const ParseResult &result : results) {
+        if (mIsError)
+            break;
+
+        mCurrentFile = result.file;
+        FileParser parser(result.file, mFlags.parseWholeFiles, this);
+        connect(&parser, &FileParser::error, this, &Scope::error);
+        connect(&parser, &FileParser::parsed, this, &Scope::onParsed);
+        connect(&parser, &FileParser::parseRequest, this, &Scope::onParseRequest);
+        connect(&parser, &FileParser::runMoc, this, &Scope::onRunMoc);
+        connect(&parser, &FileParser::runTool, this, &Scope::onRunTool);
+        connect(&parser, &FileParser::subproject, this, &Scope::subproject);
+        // Commands in the file will set it again. Sources taken out of failed
+        // batches are kept apart in mUnityFailed, see onProcessFailed()
+        mUnityExcluded.remove(result.file);
+
+        // Library includes are not parsed, but can come from project dirs
+        if (!mAutoIncludes.isEmpty()) {
+            for (const auto &event : result.events) {
+                if (event.type == ParseResult::LibraryInclude)
+                    useAutoInclude(libraryIncludeDir(event.value));
+            }
+        }
+        if (parser.apply(result)) {
+            // Keep scan results, they are reused if only file dates change
+            FileInfo info = parsedFile(result.file);
+            info.stat = result.stat;
+            info.source = result.source;
+            info.events = result.events;
+            insertParsedFile(info);
+        }
+        mUnmerged.remove(ParsedFileSet::key(result.file));
+    }
+
+    mCurrentFile.clear();
+    compileReady();
+
+    if (!mParseQueue.isEmpty() and !mIsError) {
+        startWave();
+        return;
+    }
+
+    mIsParsing = false;
+    finishParsing();
+}
+
+/*!
+ * Scope with \a scopeId (a dependency of this scope) has finished parsing.
+ * Its library is added to this scope, then compilations which were waiting
+ * for it are run. Its include paths are passed to compilations which need
+ * them, see includeFlags().
+ */
+void Scope::onDependencyParsed(const QByteArray &scopeId)
+{
+    for (const auto &scope : qAsConst(mScopeDependencies)) {
+        if (scope->id() != scopeId)
+            continue;
+
+        // TODO: this has to be made conditional: only when subproject is
+        // actually a library (and not an app, or type zero, or plugin).
+        // Update LIBS
+        addLibs(QStringList {
+                    "-L" + mFlags.prefix(),
+                    "-l" + scope->targetName()
+                });
+    }
+
+    if (mIsParsing) {
+        compileReady();
+    } else if (mHasStarted) {
+        finishParsing();
+    }
+}
+
 bool Scope::onRunMoc(const QString &file)
 {
     if (mIsError)
@@ -707,9 +2244,10 @@ bool Scope::onRunMoc(const QString &file)
     arguments.append({ file, "-o", mocFile });
 
     MetaProcessPtr mp = MetaProcessPtr::create();
+    mp->type = MetaProcess::Generate;
     mp->file = mocFile;
     mp->fileDependencies.append(findDependency(predefs));
-    mProcessQueue.append(mp);
+    addProcess(mp);
     // Generate MOC file
     emit runProcess(compiler, arguments, mp, QByteArray());
 
@@ -744,8 +2282,9 @@ void Scope::onRunTool(const QString &tool, const QStringList &args)
             qDebug() << "Running tool: rcc" << mRelativePath + "/" + qrcFile << cppFile;
 
             MetaProcessPtr mp = MetaProcessPtr::create();
+            mp->type = MetaProcess::Generate;
             mp->file = cppFile;
-            mProcessQueue.append(mp);
+            addProcess(mp);
             emit runProcess(mFlags.qtDir + "/bin/" + tool, arguments, mp,
                             QByteArray());
 
@@ -754,6 +2293,8 @@ void Scope::onRunTool(const QString &tool, const QStringList &args)
             info.path = mRelativePath + "/" + qrcFile;
             info.dateModified = file.lastModified();
             info.dateCreated = file.created();
+            info.checksum = Checksum::fileHash(file.filePath());
+            info.stat = Gibs::fileStat(file.filePath());
             info.generatedFile = cppFile;
             info.generatedObjectFile = compile(cppFile);
             insertParsedFile(info);
@@ -765,6 +2306,23 @@ void Scope::onRunTool(const QString &tool, const QStringList &args)
     }
 }
 
+/*!
+ * Handles "unity off" (\a isEnabled is false) and "unity on" commands. They
+ * apply to the file which is being parsed: with unity off, it is always
+ * compiled separately, never in a unity batch.
+ */
+void Scope::setUnityEnabled(const bool isEnabled)
+{
+    if (mCurrentFile.isEmpty())
+        return;
+
+    if (isEnabled) {
+        mUnityExcluded.remove(mCurrentFile);
+    } else {
+        mUnityExcluded.insert(mCurrentFile);
+    }
+}
+
 void Scope::onFeature(const QString &name, const bool isOn)
 {
     Gibs::Feature result;
@@ -793,6 +2351,34 @@ void Scope::onFeature(const QString &name, const bool isOn)
 void Scope::setCompiler(const Compiler &compiler)
 {
     mCompiler = compiler;
+    resetCompilerArguments();
+}
+
+void Scope::setObjectCache(const ObjectCachePtr &objectCache)
+{
+    mObjectCache = objectCache;
+    resetCompilerArguments();
+}
+
+void Scope::setFileIndex(const FileIndexPtr &fileIndex)
+{
+    mFileIndex = fileIndex;
+}
+
+const FileIndex *Scope::fileIndex() const
+{
+    return mFileIndex.data();
+}
+
+/*!
+ * Returns true if \a path exists. Project files are looked up in file index,
+ * without asking the filesystem.
+ */
+bool Scope::fileExists(const QString &path) const
+{
+    if (mFileIndex.isNull())
+        return QFileInfo::exists(path);
+    return mFileIndex->exists(path);
 }
 
 void Scope::setDeployer(const Deployer &deployer)
@@ -803,10 +2389,16 @@ void Scope::setDeployer(const Deployer &deployer)
 
 QString Scope::findFile(const QString &file) const
 {
-    return findFile(file, mCustomIncludes);
+    return findFile(file, includePaths());
 }
 
-QString Scope::findFile(const QString &file, const QStringList &includeDirs) const
+/*!
+ * Looks for \a file in current dir, in project dir and in \a includeDirs.
+ * If it is found in one of \a includeDirs, that dir is stored in
+ * \a includeDir.
+ */
+QString Scope::findFile(const QString &file, const QStringList &includeDirs,
+                        QString *includeDir) const
 {
     QString result(file);
 
@@ -814,7 +2406,7 @@ QString Scope::findFile(const QString &file, const QStringList &includeDirs) con
 
     // If file exists, just return it right away
     // TODO: check is this does not save absolute path to cache
-    if (QFileInfo::exists(result)) {
+    if (fileExists(result)) {
         //qDebug() << "RETURNING 1:" << result;
         return result;
     }
@@ -831,15 +2423,17 @@ QString Scope::findFile(const QString &file, const QStringList &includeDirs) con
     //            QFileInfo(result).canonicalFilePath());
 
     // Search through include paths
-    if (QFileInfo::exists(result)) {
+    if (fileExists(result)) {
         //qDebug() << "RETURNING 2:" << result;
         return result;
     }
 
     for (const QString &inc : qAsConst(includeDirs)) {
         const QString tempResult(mRelativePath + "/" + inc + "/" + file);
-        if (QFileInfo::exists(tempResult)) {
+        if (fileExists(tempResult)) {
             result = tempResult;
+            if (includeDir != nullptr)
+                *includeDir = inc;
             break;
         }
     }
@@ -848,11 +2442,34 @@ QString Scope::findFile(const QString &file, const QStringList &includeDirs) con
     return result;
 }
 
+/*!
+ * Marks \a includeDir as needed by this scope, if it is one of directories
+ * found by autoScanForIncludes(). Other dirs are ignored. Used dirs are
+ * passed on to scopes which depend on this one, compilations of this scope
+ * get their own set, see includeFlags().
+ */
+void Scope::useAutoInclude(const QString &includeDir)
+{
+    if (includeDir.isEmpty() or mUsedAutoIncludes.contains(includeDir)
+            or !mAutoIncludes.contains(includeDir))
+        return;
+
+    qDebug() << "Using auto include dir:" << includeDir;
+    mUsedAutoIncludes.insert(includeDir);
+}
+
 bool Scope::isFromSubproject(const QString &file) const
 {
+    const QString path(QDir::cleanPath(file));
+    const QString ownPath(QDir::cleanPath(mRelativePath) + "/");
     for (const auto &scope : qAsConst(mScopeDependencies)) {
         if (scope->isParsed(file))
             return true;
+
+        // Subproject can still be scanning, its files are not all known yet
+        const QString scopePath(QDir::cleanPath(scope->relativePath()) + "/");
+        if (scopePath != ownPath and path.startsWith(scopePath))
+            return true;
     }
 
     return false;
@@ -861,6 +2478,7 @@ bool Scope::isFromSubproject(const QString &file) const
 void Scope::updateQtModules(const QStringList &modules)
 {
     mQtModules = modules;
+    resetCompilerArguments();
     mQtIncludes.clear();
     mQtLibs.clear();
     mQtDefines.clear();
@@ -884,14 +2502,7 @@ void Scope::updateQtModules(const QStringList &modules)
 
     // TODO: pre-capitalize module letters to do both loops faster
     for(const QString &module : qAsConst(mQtModules)) {
-        const QString dir("-I" + mFlags.qtDir + "/include/Qt");
-        if (module == Tags::quickcontrols2) {
-            mQtIncludes.append(dir + "QuickControls2");
-        } else if (module == Tags::quickwidgets) {
-            mQtIncludes.append(dir + "QuickWidgets");
-        } else {
-            mQtIncludes.append(dir + Gibs::capitalizeFirstLetter(module));
-        }
+        mQtIncludes.append("-I" + mFlags.qtDir + "/include/Qt" + qtModuleName(module));
     }
 
     mQtLibs.append("-Wl,-rpath," + mFlags.qtDir + "/lib");
@@ -900,14 +2511,7 @@ void Scope::updateQtModules(const QStringList &modules)
     for(const QString &module : qAsConst(mQtModules)) {
         // TODO: use correct mkspecs
         // TODO: use qmake -query to get good paths
-        const QString lib("-lQt5");
-        if (module == Tags::quickcontrols2) {
-            mQtLibs.append(lib + "QuickControls2");
-        } else if (module == Tags::quickwidgets) {
-            mQtLibs.append(lib + "QuickWidgets");
-        } else {
-            mQtLibs.append(lib + Gibs::capitalizeFirstLetter(module));
-        }
+        mQtLibs.append("-lQt5" + qtModuleName(module));
     }
 
     if (mFlags.crossCompile == false) // TODO: why?
@@ -963,43 +2567,59 @@ bool Scope::createAndroidDeploymentJson(const QString &filePath, const QString &
     return true;
 }
 
-MetaProcessPtr Scope::findDependency(const QString &file) const
+/*!
+ * Adds \a mp to local process queue and indexes it by its target files, so
+ * that findDependency() does not have to search the queue. Duration of the
+ * same process from last build is attached to \a mp.
+ */
+void Scope::addProcess(const MetaProcessPtr &mp)
 {
-    for (const MetaProcessPtr &mp : qAsConst(mProcessQueue)) {
-        if (mp->file == file)
-            return mp;
+    // Used to start processes on the critical path of the build first
+    if (mp->expectedDuration < 0)
+        mp->expectedDuration = mJobDurations.value(mp->file, -1);
+
+    mp->scopeId = id();
+    mProcessQueue.append(mp);
+    ++mUnfinishedProcesses;
+    if (!mp->file.isEmpty())
+        mProcessIndex.insert(mp->file, mp);
+    for (const QString &output : qAsConst(mp->outputs)) {
+        if (output != mp->file)
+            mProcessIndex.insert(output, mp);
     }
+}
 
-    return MetaProcessPtr();
+/*!
+ * Returns process which produces \a file, or null pointer if there is none.
+ * If there are many, the one added first is returned.
+ */
+MetaProcessPtr Scope::findDependency(const QString &file) const
+{
+    const QList<MetaProcessPtr> processes(mProcessIndex.values(file));
+    return processes.isEmpty()? MetaProcessPtr() : processes.last();
 }
 
 QVector<MetaProcessPtr> Scope::findDependencies(const QString &file) const
 {
-    QString dependencies;
     QVector<MetaProcessPtr> result;
-    for (const MetaProcessPtr &mp : qAsConst(mProcessQueue)) {
-        if (mp->file == file) {
-            dependencies += QFileInfo(mp->file).fileName() + ", ";
-            result.append(mp);
-        }
-    }
+    const QList<MetaProcessPtr> processes(mProcessIndex.values(file));
+    // QMultiHash returns the most recently inserted first
+    for (auto it = processes.crbegin(); it != processes.crend(); ++it)
+        result.append(*it);
 
-    qDebug() << "File" << file << "depends on:" << dependencies;
+    if (!result.isEmpty())
+        qDebug() << "File" << file << "depends on:" << result.size() << "processes";
 
     return result;
 }
 
+/*!
+ * Returns all processes of this scope. Shares data with the process queue,
+ * no copy is made.
+ */
 QVector<MetaProcessPtr> Scope::findAllDependencies() const
 {
-    QString dependencies;
-    QVector<MetaProcessPtr> result;
-    for (const MetaProcessPtr &mp : qAsConst(mProcessQueue)) {
-        dependencies += QFileInfo(mp->file).fileName() + ", ";
-        result.append(mp);
-    }
-
-    qDebug() << "All dependencies:" << dependencies;
-    return result;
+    return mProcessQueue;
 }
 
 bool Scope::initializeMoc()
@@ -1021,8 +2641,9 @@ bool Scope::initializeMoc()
     //mParsedFiles.insert(predefs, info);
 
     MetaProcessPtr mp = MetaProcessPtr::create();
+    mp->type = MetaProcess::Generate;
     mp->file = predefs;
-    mProcessQueue.append(mp);
+    addProcess(mp);
     emit runProcess(compiler, arguments, mp, QByteArray());
     setQtIsMocInitialized(true);
     return qtIsMocInitialized();
@@ -1048,6 +2669,14 @@ QVector<QByteArray> Scope::scopeDependencyIds() const
     return mScopeDependencyIds;
 }
 
+/*!
+ * Returns object cache keys of all objects compiled in this scope.
+ */
+QVector<QByteArray> Scope::objectCacheKeys() const
+{
+    return mObjectCacheKeys.values().toVector();
+}
+
 void Scope::setTargetLibType(const QString &targetLibType)
 {
     mTargetLibType = targetLibType;
@@ -1070,9 +2699,59 @@ void Scope::setQtIsMocInitialized(bool qtIsMocInitialized)
 
 void Scope::start(bool fromCache, bool isQuickMode)
 {
+    mHasStarted = true;
+
+    // Scan results depend on whether whole files were scanned, and on
+    // features
+    const bool canReuseScans = (mScanSignature == scanSignature());
+    mScanSignature = scanSignature();
+
     // First, check if any files need to be recompiled
     if (fromCache) {
+        preparePch();
+
         const auto files = parsedFiles();
+
+        // Unity build has been turned off, sources leave their batches
+        if (!mFlags.unity) {
+            for (const auto &cached : files) {
+                if (isUnityObject(cached.objectFile))
+                    compileSource(cached.path);
+            }
+        }
+
+        // Every file is stat()ed once. Only files whose metadata has changed
+        // are checked further, changed dependencies lead to affected sources
+        // through the reverse index (see below)
+        QHash<QString, Gibs::FileStat> stats;
+        QSet<QString> dirtyFiles;
+        const QStringList changedFiles(findChangedFiles(stats));
+        for (const QString &file : changedFiles) {
+            if (mIsError)
+                return;
+
+            if (!isFileDirty(file, stats.value(file), isQuickMode))
+                continue;
+
+            dirtyFiles.insert(file);
+            const FileInfo cached(parsedFile(file));
+            if (cached.type == FileInfo::Cpp) {
+                // Dirty files are parsed together, see below
+                if (canReuseScans)
+                    mScanCache.insert(cached.path, cached.toParseResult());
+                parseFile(cached.path);
+            } else if (cached.type == FileInfo::QRC) {
+                onRunTool(Tags::rcc, QStringList({ cached.path }));
+            }
+        }
+
+        // Objects are looked up in one listing of the build dir, instead of
+        // checking each of them on disk
+        QSet<QString> outputs;
+        const QStringList outputList(QDir::current().entryList(QDir::Files));
+        for (const QString &output : outputList)
+            outputs.insert(output);
+
         for (const auto &cached : files) {
             // Check if object file exists. If somebody removed it, or used
             // --clean, then we have to recompile!
@@ -1080,26 +2759,19 @@ void Scope::start(bool fromCache, bool isQuickMode)
             if (mIsError)
                 return;
 
-            if (isFileDirty(cached.path, isQuickMode)) {
-                if (cached.type == FileInfo::Cpp) {
-                    parseFile(cached.path);
-                } else if (cached.type == FileInfo::QRC) {
-                    onRunTool(Tags::rcc, QStringList({ cached.path }));
-                }
+            if (dirtyFiles.contains(cached.path)) {
+                continue;
             } else if (!cached.objectFile.isEmpty()) {
                 // There should be an object file on disk - let's check
-                const QFileInfo objFile(cached.objectFile);
-                if (!objFile.exists()) {
+                if (!outputs.contains(cached.objectFile)) {
                     qDebug() << "Object file missing - recompiling";
-                    compile(cached.path);
+                    compileSource(cached.path);
                 }
             } else if (!cached.generatedObjectFile.isEmpty()) {
                 // There should be an object file on disk - let's check
-                const QFileInfo objFile(cached.generatedObjectFile);
-                if (!objFile.exists()) {
+                if (!outputs.contains(cached.generatedObjectFile)) {
                     qDebug() << "Generated object file missing - recompiling";
-                    const QFileInfo genFile(cached.generatedFile);
-                    if (!genFile.exists()) {
+                    if (!outputs.contains(cached.generatedFile)) {
                         qDebug() << "Generated file missing - regenerating";
                         if (cached.type == FileInfo::Cpp) {
                             // Moc file needs to be regenerated
@@ -1114,19 +2786,273 @@ void Scope::start(bool fromCache, bool isQuickMode)
                 }
             }
         }
+
+        // Files which depend on changed headers. Files which are parsed
+        // again are compiled after parsing anyway
+        const QStringList affectedFiles(findAffectedFiles(stats));
+        for (const QString &file : affectedFiles) {
+            if (mUnmerged.contains(ParsedFileSet::key(file)))
+                continue;
+
+            const FileInfo info(parsedFile(file));
+            if (!info.objectFile.isEmpty()) {
+                qDebug() << "Dependency changed - recompiling" << file;
+                compileSource(file);
+            }
+            if (!info.generatedObjectFile.isEmpty()
+                    and QFileInfo::exists(info.generatedFile)) {
+                qDebug() << "Dependency changed - recompiling" << info.generatedFile;
+                compile(info.generatedFile);
+            }
+        }
     } else {
         //qDebug() << "I SHOULD BE HERE!" << mName;
         onParseRequest(mName);
     }
 
-    // Parsing done, link it!
-    link();
+    // Link and deploy are scheduled when parsing finishes
+    parsePending();
+}
 
-    // Linking is scheduled, deploy it!
-    if (mDeploy and targetType() == Tags::targetApp) {
-        // Use the deployment tool!
-        deploy();
+/*!
+ * Reads depfiles of all objects compiled in this run and stores the list of
+ * their dependencies (including system and Qt headers, which FileParser does
+ * not look into) in cache. Should be called after compilation is done.
+ *
+ * Objects of generated files (MOC, RCC) keep their own list, next to the list
+ * of the object of the file they are generated from.
+ *
+ * Stats of dependencies are stored as they were when compilation started: a
+ * dependency modified after that is stored as changed, so that its dependents
+ * are compiled again in next build.
+ */
+void Scope::readDepfiles()
+{
+    if (mCompiledObjects.isEmpty())
+        return;
+
+    QSet<QString> modifiedDependencies;
+    const auto updateStats = [this, &modifiedDependencies](
+            const QStringList &dependencies, const QString &objectFile) {
+        // Objects restored from cache have no process, they count from the
+        // time they were scheduled
+        const MetaProcessPtr mp(findDependency(objectFile));
+        const qint64 started = (mp.isNull() or mp->startTime < 0)?
+                    mCompiledObjects.value(objectFile) : mp->startTime;
+
+        for (const QString &dependency : dependencies) {
+            if (modifiedDependencies.contains(dependency))
+                continue;
+
+            Gibs::FileStat stat(Gibs::fileStat(dependency));
+            if (stat.modified >= started) {
+                modifiedDependencies.insert(dependency);
+                stat = Gibs::FileStat();
+            }
+            mDependencyStats.insert(dependency, stat);
+        }
+    };
+
+    for (auto &info : mParsedFiles) {
+        const bool isObjectCompiled = (!info.objectFile.isEmpty()
+                                       and mCompiledObjects.contains(info.objectFile));
+        const bool isGeneratedObjectCompiled = (!info.generatedObjectFile.isEmpty()
+                                                and mCompiledObjects.contains(
+                                                    info.generatedObjectFile));
+        if (!isObjectCompiled and !isGeneratedObjectCompiled)
+            continue;
+
+        const QStringList previousDependencies(info.dependencies
+                                               + info.generatedDependencies);
+
+        // Compiled file itself is not a dependency. Unity batch has its own
+        // generated source
+        if (isObjectCompiled) {
+            info.dependencies = Gibs::readDepfile(depfileName(info.objectFile));
+            info.dependencies.removeAll(isUnityObject(info.objectFile)?
+                                            unitySourceFile(info.objectFile)
+                                          : info.path);
+        }
+        if (isGeneratedObjectCompiled) {
+            info.generatedDependencies = Gibs::readDepfile(
+                        depfileName(info.generatedObjectFile));
+            info.generatedDependencies.removeAll(info.generatedFile);
+        }
+
+        // Update reverse index
+        QSet<QString> dependencies;
+        for (const QString &dependency : qAsConst(info.dependencies))
+            dependencies.insert(dependency);
+        for (const QString &dependency : qAsConst(info.generatedDependencies))
+            dependencies.insert(dependency);
+
+        for (const QString &dependency : previousDependencies) {
+            if (dependencies.contains(dependency))
+                continue;
+
+            auto it = mDependents.find(dependency);
+            if (it == mDependents.end())
+                continue;
+            it.value().removeOne(info.path);
+            if (it.value().isEmpty()) {
+                mDependents.erase(it);
+                mDependencyStats.remove(dependency);
+            }
+        }
+        for (const QString &dependency : qAsConst(dependencies)) {
+            QStringList &dependents = mDependents[dependency];
+            if (!dependents.contains(info.path))
+                dependents.append(info.path);
+        }
+
+        if (isObjectCompiled)
+            updateStats(info.dependencies, info.objectFile);
+        if (isGeneratedObjectCompiled)
+            updateStats(info.generatedDependencies, info.generatedObjectFile);
+    }
+
+    mCompiledObjects.clear();
+}
+
+/*!
+ * Puts objects compiled in this run into object cache. Should be called after
+ * compilation is done.
+ */
+void Scope::storeObjects()
+{
+    if (mObjectCache.isNull())
+        return;
+
+    for (auto it = mCacheMisses.constBegin(); it != mCacheMisses.constEnd(); ++it) {
+        mObjectCache->store(it.value(), it.key(), depfileName(it.key()));
+    }
+
+    mCacheMisses.clear();
+}
+
+/*!
+ * Remembers how long each process took in this run. Durations are used to
+ * prioritize processes in next build.
+ *
+ * Compile time of each source is stored, too. It is used to balance unity
+ * batches and groups of small sources. Time of a process which has compiled
+ * several sources is divided between them according to their sizes.
+ */
+void Scope::recordDurations()
+{
+    // Object file, process which has produced it
+    QHash<QString, MetaProcessPtr> processes;
+    for (const MetaProcessPtr &mp : qAsConst(mProcessQueue)) {
+        if (mp->duration < 0 or mp->hasFailed)
+            continue;
+
+        if (!mp->file.isEmpty())
+            mJobDurations.insert(mp->file, mp->duration);
+
+        processes.insert(mp->file, mp);
+        for (const QString &output : qAsConst(mp->outputs))
+            processes.insert(output, mp);
+    }
+
+    if (processes.isEmpty())
+        return;
+
+    // Process, sources compiled by it
+    QHash<MetaProcessPtr, QVector<FileInfo *>> sources;
+    for (auto &info : mParsedFiles) {
+        const MetaProcessPtr mp(processes.value(info.objectFile));
+        if (!mp.isNull())
+            sources[mp].append(&info);
+    }
+
+    for (auto it = sources.constBegin(); it != sources.constEnd(); ++it) {
+        qint64 totalSize = 0;
+        for (const FileInfo *info : it.value())
+            totalSize += qMax<qint64>(info->stat.size, 1);
+
+        const qint64 duration = it.key()->duration;
+        for (FileInfo *info : it.value()) {
+            info->compileTime = duration * qMax<qint64>(info->stat.size, 1)
+                    / totalSize;
+        }
+    }
+}
+
+/*!
+ * Unity batch \a mp has failed to compile (for example because of name
+ * clashes between its sources). Its sources are compiled separately instead,
+ * and stay out of unity batches until one of them has to be recompiled (see
+ * retryUnity()). Their objects are then merged into the batch object, which
+ * linking is waiting for.
+ */
+void Scope::onProcessFailed(const MetaProcessPtr &mp)
+{
+    if (!mProcessQueue.contains(mp) or !mUnityBatches.contains(mp->file))
+        return;
+
+    const QString batchObject(mp->file);
+    const QStringList sources(mUnityBatches.take(batchObject));
+    qWarning() << "Unity batch failed, compiling its sources separately:"
+               << batchObject;
+
+    mCacheMisses.remove(batchObject);
+    mObjectCacheKeys.remove(batchObject);
+    mCompiledObjects.remove(batchObject);
+
+    // Batch object is still produced below, from objects of its sources.
+    // No source refers to it in next build, clean() removes it by name
+    Gibs::removeFile(unitySourceFile(batchObject));
+    Gibs::removeFile(depfileName(batchObject));
+
+    QVector<MetaProcessPtr> compilations;
+    QStringList objectFiles;
+    for (const QString &source : sources) {
+        const QString objectFile(QFileInfo(source).baseName() + ".o");
+        mUnityFailed.insert(source, batchObject);
+
+        FileInfo info(parsedFile(source));
+        info.objectFile = objectFile;
+        insertParsedFile(info);
+
+        runCompiler(source, objectFile, info.contents);
+        objectFiles.append(objectFile);
+    }
+
+    compileSmallSources();
+    for (const QString &objectFile : qAsConst(objectFiles)) {
+        const MetaProcessPtr compilation(findDependency(objectFile));
+        if (!compilation.isNull() and !compilations.contains(compilation))
+            compilations.append(compilation);
+    }
+
+    // Partial link: link step still expects the batch object
+    MetaProcessPtr merge = MetaProcessPtr::create();
+    merge->type = MetaProcess::Link;
+    merge->file = batchObject;
+    merge->fileDependencies = compilations;
+    for (const MetaProcessPtr &queued : qAsConst(mProcessQueue)) {
+        if (queued->fileDependencies.contains(mp))
+            queued->addDependency(merge);
     }
+    addProcess(merge);
+
+    QStringList arguments { "-r", "-nostdlib", "-o", batchObject };
+    arguments.append(objectFiles);
+    emit runProcess(compilerCommand(unitySourceFile(batchObject)), arguments,
+                    merge, QByteArray());
+}
+
+/*!
+ * Process \a mp of this scope has finished. When it was the last one (and
+ * parsing is done), finished() is emitted.
+ */
+void Scope::onProcessFinished(const MetaProcessPtr &mp)
+{
+    if (mp->scopeId != id())
+        return;
+
+    --mUnfinishedProcesses;
+    checkFinished();
 }
 
 void Scope::clean()
@@ -1139,6 +3065,30 @@ void Scope::clean()
             Gibs::removeFile(info.generatedFile);
         if (!info.generatedObjectFile.isEmpty())
             Gibs::removeFile(info.generatedObjectFile);
+        if (!info.objectFile.isEmpty())
+            Gibs::removeFile(depfileName(info.objectFile));
+        if (isUnityObject(info.objectFile))
+            Gibs::removeFile(unitySourceFile(info.objectFile));
+    }
+
+    const QString pchHeader(targetName() + pchHeaderSuffix);
+    Gibs::removeFile(pchHeader);
+    Gibs::removeFile(pchHeader + mCompiler.pchSuffix);
+    Gibs::removeFile(depfileName(pchHeader));
+
+    const QStringList responseFiles(QDir::current().entryList(
+        { targetName() + responseFileChecksumPattern + responseFileSuffix },
+        QDir::Files));
+    for (const QString &responseFile : responseFiles) {
+        Gibs::removeFile(responseFile);
+    }
+
+    // Also batches which are no longer used (their sources have failed to
+    // compile together)
+    const QStringList unityFiles(QDir::current().entryList(
+        { unityPrefix + targetName() + "_[0-9]*" }, QDir::Files));
+    for (const QString &unityFile : unityFiles) {
+        Gibs::removeFile(unityFile);
     }
 
     if (!qtModules().isEmpty()) {
@@ -6,17 +6,23 @@
 #include <QHash>
 #include <QScopedPointer>
 #include <QVersionNumber>
+#include <QFutureWatcher>
+#include <QSet>
 
 #include <QJsonObject>
 #include <QJsonArray>
 
 #include "fileinfo.h"
+#include "parsedfileset.h"
+#include "parseresult.h"
 #include "tags.h"
 #include "metaprocess.h"
 #include "gibs.h"
 #include "flags.h"
 #include "compiler.h"
 #include "deployer.h"
+#include "objectcache.h"
+#include "fileindex.h"
 
 class Scope;
 
@@ -42,13 +48,17 @@ public:
     void mergeWith(const ScopePtr &other);
     void dependOn(const ScopePtr &other);
     bool isFinished() const;
+    bool isParsing() const;
 
     QList<FileInfo> parsedFiles() const;
     void insertParsedFile(const FileInfo &fileInfo);
+    void clearChecksums();
     FileInfo parsedFile(const QString &path) const;
     bool isParsed(const QString &path) const;
 
     QStringList includePaths() const;
+    QStringList usedIncludePaths() const;
+    QStringList scopeIncludePaths() const;
     QStringList customIncludeFlags() const;
     void autoScanForIncludes();
 
@@ -71,6 +81,7 @@ public:
     void setTargetLibType(const QString &targetLibType);
 
     QVector<QByteArray> scopeDependencyIds() const;
+    QVector<QByteArray> objectCacheKeys() const;
 
     QVersionNumber version() const;
     void setVersion(const QVersionNumber &version);
@@ -80,6 +91,14 @@ public:
 public slots:
     void start(bool fromCache, bool isQuickMode);
     void clean();
+    void readDepfiles();
+    void storeObjects();
+    void updateLinkSignature();
+    void updatePchSignature();
+    void removeStaleResponseFiles();
+    void recordDurations();
+    void onProcessFailed(const MetaProcessPtr &mp);
+    void onProcessFinished(const MetaProcessPtr &mp);
 
     void addIncludePaths(const QStringList &includes);
     void setTargetName(const QString &target);
@@ -88,9 +107,14 @@ public slots:
     void addDefines(const QStringList &defines);
     void addLibs(const QStringList &libs);
     void onFeature(const QString &name, const bool isOn);
+    void setUnityEnabled(const bool isEnabled);
 
     void setCompiler(const Compiler &compiler);
     void setDeployer(const Deployer &deployer);
+    void setObjectCache(const ObjectCachePtr &objectCache);
+    void setFileIndex(const FileIndexPtr &fileIndex);
+    const FileIndex *fileIndex() const;
+    bool fileExists(const QString &path) const;
 
 signals:
     void error(const QString &error) const;
@@ -98,13 +122,80 @@ signals:
                     const MetaProcessPtr &mp, const QByteArray &data) const;
     void subproject(const QByteArray &scopeId, const QString &path) const;    
     void feature(const Gibs::Feature &feature) const;
+    void parsingFinished(const QByteArray &scopeId) const;
+    void finished(const QByteArray &scopeId) const;
 
 protected:
+    /*!
+     * Compilation requested while parsing is still in progress. It waits
+     * until \a owner and all files it includes are parsed, so that gibs
+     * commands found in included files are taken into account.
+     */
+    struct PendingCompile {
+        QString file;
+        QString objectFile;
+        QByteArray contents;
+        QString owner;
+    };
+
+    /*!
+     * Include dirs needed to compile some files, see includeUsage().
+     */
+    struct IncludeUsage {
+        //! Auto include dirs in which includes were found
+        QSet<QString> autoIncludes;
+        //! Some include comes from a scope this one depends on
+        bool usesScopes = false;
+        //! Some file defines or undefines a macro before its includes
+        bool definesMacros = false;
+    };
+
     QString compile(const QString &file, const FileInfo &fileInfo = FileInfo());
-    void link();
+    QString compileSource(const QString &file, const FileInfo &fileInfo = FileInfo());
+    void retryUnity(const QString &batchObject);
+    bool isUnityCandidate(const QString &file) const;
+    static bool isUnityObject(const QString &objectFile);
+    static QString unitySourceFile(const QString &objectFile);
+    void compileUnity();
+    bool isSmallSource(const QString &file, const QString &objectFile) const;
+    void compileSmallSources();
+    void runCompiler(const QString &file, const QString &objectFile,
+                     const QByteArray &contents);
+    QString compilerCommand(const QString &file) const;
+    QStringList compilerArguments() const;
+    QStringList commonArguments();
+    QStringList includeFlags(const IncludeUsage &usage) const;
+    IncludeUsage includeUsage(const QStringList &files,
+                              const QStringList &libraryIncludes = QStringList()) const;
+    QString autoIncludeDir(const QString &path, const QString &include) const;
+    QString libraryIncludeDir(const QString &include) const;
+    bool isScopeHeader(const QString &include) const;
+    void resetCompilerArguments();
+    QStringList pchHeaders() const;
+    QString pchFile() const;
+    QStringList pchArguments() const;
+    QByteArray pchSignature() const;
+    QByteArray scanSignature() const;
+    void preparePch();
+    void compilePending();
+    void compileReady();
+    QStringList objectFiles() const;
+    QString targetFile() const;
+    QByteArray linkSignature() const;
+    bool link();
     void deploy();
     void parseFile(const QString &file);
-    bool isFileDirty(const QString &file, const bool isQuickMode) const;
+    void parsePending();
+    void startWave();
+    void finishParsing();
+    void checkFinished();
+    bool isClosureParsed(const QString &file, QSet<QString> &visited) const;
+    bool isWaitingForScopes() const;
+    bool isFileDirty(const QString &file, const Gibs::FileStat &stat,
+                     const bool isQuickMode);
+    QStringList findChangedFiles(QHash<QString, Gibs::FileStat> &stats) const;
+    QStringList findAffectedFiles(QHash<QString, Gibs::FileStat> &stats) const;
+    static QString depfileName(const QString &objectFile);
 
 protected slots:
     void onParsed(const QString &file, const QString &source,
@@ -116,15 +207,20 @@ protected slots:
     bool onRunMoc(const QString &file);
     void onRunTool(const QString &tool,
                    const QStringList &args);
+    void onWaveScanned();
+    void onDependencyParsed(const QByteArray &scopeId);
 
 protected:
     Scope(const QByteArray &id, const QString &name, const QString &relativePath,
           const Flags &flags);
-    QString findFile(const QString &file, const QStringList &includeDirs) const;
+    QString findFile(const QString &file, const QStringList &includeDirs,
+                     QString *includeDir = nullptr) const;
+    void useAutoInclude(const QString &includeDir);
     bool isFromSubproject(const QString &file) const;
     void updateQtModules(const QStringList &modules);
     bool createAndroidDeploymentJson(const QString &filePath, const QString &binary) const;
 
+    void addProcess(const MetaProcessPtr &mp);
     MetaProcessPtr findDependency(const QString &file) const;
     QVector<MetaProcessPtr> findDependencies(const QString &file) const;
     QVector<MetaProcessPtr> findAllDependencies() const;
@@ -134,6 +230,8 @@ protected:
     Flags mFlags;
     Compiler mCompiler;
     Deployer mDeployer;
+    ObjectCachePtr mObjectCache;
+    FileIndexPtr mFileIndex;
 
     const QString mRelativePath;
     const QString mName;
@@ -155,7 +253,73 @@ protected:
 
     QStringList mCustomIncludes;
     QStringList mCustomIncludeFlags;
+    // Directories found by autoScanForIncludes(). Each compilation gets
+    // those in which its includes are found, see includeFlags()
+    QStringList mAutoIncludes;
+    // Auto include dirs used by any file of this scope
+    QSet<QString> mUsedAutoIncludes;
+    // Library include, auto include dir in which it is found (empty if none)
+    mutable QHash<QString, QString> mLibraryIncludeDirs;
+    // Library include, whether it is found in a scope this one depends on
+    mutable QHash<QString, bool> mScopeHeaders;
     QHash<QString, FileInfo> mParsedFiles;
+    // File name (see ParsedFileSet::key()), path of parsed file it belongs
+    // to. Generated files point to the file they are generated from
+    QHash<QString, QString> mFileKeys;
+    ParsedFileSet mParsedSet;
+    // Files waiting to be parsed in next wave
+    QStringList mParseQueue;
+    QFutureWatcher<ParseResult> mParseWatcher;
+    // File currently being merged into the scope
+    QString mCurrentFile;
+    // Names of files which are queued or being scanned
+    QSet<QString> mUnmerged;
+    // File name, names of files it includes
+    QHash<QString, QStringList> mIncludeGraph;
+    // Path, results of scan from previous run
+    QHash<QString, ParseResult> mScanCache;
+    // scanSignature() of settings with which mScanCache was made
+    QByteArray mScanSignature;
+    QVector<PendingCompile> mPendingCompiles;
+    // Result of compilerArguments(), computed once per configuration
+    mutable QStringList mCompilerArguments;
+    mutable bool mHasCompilerArguments = false;
+    // Response file with mCompilerArguments, see commonArguments()
+    QString mResponseFile;
+    // Compilations waiting to be grouped, see compileSmallSources()
+    QVector<PendingCompile> mSmallCompiles;
+    QSet<QString> mScheduledObjects;
+    // Object files compiled in this run (their depfiles need to be read), time
+    // they were scheduled (ns since epoch, like Gibs::FileStat::modified)
+    QHash<QString, qint64> mCompiledObjects;
+    // Object file, object cache key. Objects not found in cache
+    QHash<QString, QByteArray> mCacheMisses;
+    // Object file, object cache key it was last compiled (or restored) with
+    QHash<QString, QByteArray> mObjectCacheKeys;
+    // Path, metadata of a dependency reported by the compiler
+    QHash<QString, Gibs::FileStat> mDependencyStats;
+    // Path of dependency, source files which depend on it (reverse index)
+    QHash<QString, QStringList> mDependents;
+    // Checksum of link inputs from last successful build
+    QByteArray mLinkSignature;
+    // Generated header with common library includes, passed with -include
+    QString mPchHeader;
+    // Library headers included in mPchHeader
+    QStringList mPchHeaders;
+    // Process building precompiled header in this run, compilations wait for it
+    MetaProcessPtr mPchProcess;
+    // Checksum of precompiled header inputs from last successful build
+    QByteArray mPchSignature;
+    // Sources waiting to be put into unity batches
+    QSet<QString> mUnityQueue;
+    // Unity batches (object files) whose list of sources has changed
+    QSet<QString> mDirtyUnityBatches;
+    // Unity batch object file, its sources. Only batches compiled in this run
+    QHash<QString, QStringList> mUnityBatches;
+    // Sources which are always compiled separately ("unity off" command)
+    QSet<QString> mUnityExcluded;
+    // Source, unity batch which has failed to compile. See onProcessFailed()
+    QHash<QString, QString> mUnityFailed;
     // Name, Feature
     QHash<QString, Gibs::Feature> mFeatures;
     QVector<QByteArray> mScopeDependencyIds;
@@ -163,8 +327,18 @@ protected:
     // TODO: change into QStringList and use only file names here.
     // MetaProcessPtr can remain in ProjectManager, but not really here.
     QVector<MetaProcessPtr> mProcessQueue; // Local process queue
+    // Target file (or output), process which produces it
+    QMultiHash<QString, MetaProcessPtr> mProcessIndex;
+    // Target file of a process, how long it took in last build (ms)
+    QHash<QString, qint64> mJobDurations;
+    // Processes in mProcessQueue which have not finished yet
+    int mUnfinishedProcesses = 0;
 
     bool mIsError = false;
+    bool mIsParsing = false;
+    bool mHasStarted = false;
+    bool mHasFinishedParsing = false;
+    bool mHasFinished = false;
     bool mDeploy = false;
     bool mQtIsMocInitialized = false;
 };
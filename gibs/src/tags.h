@@ -41,6 +41,17 @@ const QLatin1String androidSdkPath("android-sdk-path");
 const QLatin1String androidSdkApi("android-sdk-api");
 const QLatin1String jdkPath("jdk-path");
 const QLatin1String pipe_flag("pipe");
+const QLatin1String cache_size_flag("cache-size");
+const QLatin1String cache_dir_flag("cache-dir");
+const QLatin1String export_cache_flag("export-cache");
+const QLatin1String no_pch_flag("no-pch");
+const QLatin1String unity_flag("unity");
+const QLatin1String unity_batches_flag("unity-batches");
+const QLatin1String multi_compile_flag("multi-compile");
+const QLatin1String import_cache_flag("import-cache");
+// Object cache path placeholders
+const QLatin1String sourceRootPrefix("SOURCE_ROOT");
+const QLatin1String qtDirPrefix("QT_DIR");
 // General
 const QLatin1String gibsCacheFileName(".gibs.cache");
 const QLatin1String gibsConfigFileName(".gibsPathConfig.ini");
@@ -70,6 +81,7 @@ const QLatin1String depends("depends on");
 const QLatin1String link("link(");
 const QLatin1String linkEnd(")");
 const QLatin1String version("version");
+const QLatin1String unity("unity");
 const QLatin1String feature("feature");
 const QLatin1String featureDefault("default");
 const QLatin1String featureOn("on");
@@ -102,6 +114,7 @@ const QLatin1String uic("uic");
 // Cache file tags
 const QLatin1String parsedFiles("parsedFiles");
 const QLatin1String fileChecksum("fileChecksum");
+const QLatin1String checksumAlgorithm("checksumAlgorithm");
 const QLatin1String fileModificationDate("fileModificationDate");
 const QLatin1String scopeId("scopeId");
 const QLatin1String scopeName("scopeName");
@@ -110,6 +123,23 @@ const QLatin1String scopes("scopes");
 const QLatin1String scopeDependencies("scopeDependencies");
 const QLatin1String relativePath("relativePath");
 const QLatin1String targetLibType("targetLibType");
+const QLatin1String scanSignature("scanSignature");
+const QLatin1String dependencyStats("dependencyStats");
+const QLatin1String dependents("dependents");
+const QLatin1String linkSignature("linkSignature");
+const QLatin1String objectCacheKeys("objectCacheKeys");
+const QLatin1String pchSignature("pchSignature");
+const QLatin1String unityExcluded("unityExcluded");
+const QLatin1String unityFailed("unityFailed");
+const QLatin1String autoIncludes("autoIncludes");
+const QLatin1String usedAutoIncludes("usedAutoIncludes");
+const QLatin1String fileIndex("fileIndex");
+const QLatin1String jobDurations("jobDurations");
+const QLatin1String eventInclude("include");
+const QLatin1String eventCommand("command");
+const QLatin1String eventMoc("moc");
+const QLatin1String eventLibraryInclude("libraryInclude");
+const QLatin1String eventDefine("define");
 // Platform ifdefs
 // TODO: keeping them stored here is a horrible idea. Gibs should understand
 // ifdefs dynamically!
@@ -130,6 +160,12 @@ const QLatin1String ccompiler("ccompiler");
 const QLatin1String compilerFlags("flags");
 const QLatin1String compilerDebugFlags("debugFlags");
 const QLatin1String compilerReleaseFlags("releaseFlags");
+const QLatin1String compilerDepfileFlags("depfileFlags");
+const QLatin1String compilerPrefixMapFlags("prefixMapFlags");
+const QLatin1String compilerPchFlags("pchFlags");
+const QLatin1String compilerPchSuffix("pchSuffix");
+const QLatin1String compilerMultiDepfileFlags("multiDepfileFlags");
+const QLatin1String compilerResponseFileFlag("responseFileFlag");
 const QLatin1String linker("linker");
 const QLatin1String staticArchiver("staticArchiver");
 const QLatin1String libraryPrefix("libraryPrefix");
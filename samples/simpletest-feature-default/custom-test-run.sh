@@ -0,0 +1,9 @@
+#!/bin/bash
+
+# This is a helper script for scripts/run-compilation-tests.sh
+
+# Feature is on by default, without command line flags. Its ifdef follows
+# the declaration in the same file
+CUSTOM_PATH="main.cpp"
+CUSTOM_ARGS=""
+EXPECTED_OUTPUTS="someclass.o"
@@ -0,0 +1,19 @@
+//i target name SimpleTestFeatureDefault
+//i qt core
+//i feature my-feature default on
+
+#ifdef MY_FEATURE
+#include "someclass.h"
+#endif
+
+#include <QDebug>
+
+int main() {
+#ifdef MY_FEATURE
+    SomeClass sc;
+    qDebug() << sc.text();
+#else
+    qDebug() << "No feature!";
+#endif
+    return 0;
+}
@@ -0,0 +1,9 @@
+QT = core
+
+TEMPLATE = app
+
+DEFINES += MY_FEATURE
+
+HEADERS = someclass.h
+
+SOURCES = someclass.cpp main.cpp
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <QString>
+
+class SomeClass
+{
+public:
+    QString text() const;
+};
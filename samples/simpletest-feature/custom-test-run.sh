@@ -4,3 +4,4 @@
 
 CUSTOM_PATH="main.cpp"
 CUSTOM_ARGS="-- --my-feature"
+EXPECTED_OUTPUTS="someclass.o"
@@ -74,6 +74,7 @@ for dir in ../samples/* ; do
   CUSTOM_PATH="main.cpp"
   CUSTOM_ARGS=""
   QMAKE_CUSTOM_ARGS=""
+  EXPECTED_OUTPUTS=""
 
   if [ -f "$SOURCE/custom-test-run.sh" ]; then
     echo "Extracting custom flags from custom-test-run.sh"
@@ -98,6 +99,14 @@ for dir in ../samples/* ; do
     exit $EXIT_CODE
   fi
 
+  # Files which have to be built, for example sources behind feature ifdefs
+  for output in $EXPECTED_OUTPUTS ; do
+    if [ ! -f "$output" ]; then
+      echo "GIBS did not build: $output"
+      exit 1
+    fi
+  done
+
   if [ -f "$QMAKEEXE" ]; then
     ts=$(date +%s%N)
     $QMAKEEXE $QMAKE_CUSTOM_ARGS $SOURCE/ && make -j $JOBS >> $DETAILS 2>&1
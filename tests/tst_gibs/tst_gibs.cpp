@@ -23,6 +23,24 @@ SOFTWARE.
 
 #include <QtTest>
 #include <QCoreApplication>
+#include <QTemporaryDir>
+
+#include "prefilter.h"
+#include "checksum.h"
+#include "gibs.h"
+#include "cachebundle.h"
+#include "objectcache.h"
+#include "fileindex.h"
+
+/*!
+ * Gives tests access to protected parts of ObjectCache.
+ */
+class TestObjectCache : public ObjectCache
+{
+public:
+    using ObjectCache::ObjectCache;
+    using ObjectCache::normalized;
+};
 
 class TestGibs : public QObject
 {
@@ -32,18 +50,279 @@ private slots:
     void initTestCase();
     void cleanupTestCase();
 
+    void testPrefilter();
+    void testChecksum();
+    void testReadDepfile();
+    void testCacheBundle();
+    void testCacheBundleBounds();
+    void testObjectCacheNormalized();
+    void testFileIndex();
+
+private:
+    bool writeFile(const QString &path, const QByteArray &data) const;
+
+    QTemporaryDir mDir;
 };
 
 void TestGibs::initTestCase()
 {
     QCoreApplication::setApplicationName("gibs Unit Test");
     QCoreApplication::setOrganizationName("");
+    QVERIFY(mDir.isValid());
 }
 
 void TestGibs::cleanupTestCase()
 {
 }
 
+bool TestGibs::writeFile(const QString &path, const QByteArray &data) const
+{
+    QFile file(path);
+    return (file.open(QFile::WriteOnly) and file.write(data) == data.size());
+}
+
+/*!
+ * Scalar reference for Prefilter::nextCandidateLine(): returns offset of the
+ * first line at or after \a begin which starts with a marker.
+ */
+static int candidateLine(const QByteArray &text, int begin)
+{
+    while (begin < text.size()) {
+        int end = text.indexOf('\n', begin);
+        if (end < 0)
+            end = text.size();
+
+        int first = begin;
+        while (first < end and QByteArray(" \t\r\v\f").contains(text.at(first)))
+            ++first;
+
+        const QByteArray line(text.mid(first, end - first));
+        if (line.startsWith('#') or line.startsWith("//i") or line.startsWith("/*i")
+                or line.startsWith("Q_OBJECT") or line.startsWith("Q_GADGET"))
+            return begin;
+
+        begin = end + 1;
+    }
+
+    return text.size();
+}
+
+void TestGibs::testPrefilter()
+{
+    qInfo() << "Prefilter implementation:" << Prefilter::implementationName();
+
+    const QVector<QByteArray> lines {
+        "int a = 0;", "  #include <QObject>", "\t// plain comment",
+        "//i unity off", "/*i", "x = Q_OBJECT;", "    Q_OBJECT", "Q_GADGET",
+        "QString text;", "", "a / b; // Q", "Q_OBJ", "#", "\v\f/*i qt core",
+        "const char *s = \"#include\";",
+        "some long line which is longer than one vector register of any kind"
+    };
+
+    // Same pseudo-random sequence every time, lines land on all offsets
+    // within vector registers
+    quint32 seed = 12345;
+    for (int round = 0; round < 200; ++round) {
+        QByteArray text;
+        const int count = round % 40;
+        for (int i = 0; i < count; ++i) {
+            seed = seed * 1103515245 + 12345;
+            text.append(lines.at(int((seed >> 16) % quint32(lines.size()))));
+            text.append('\n');
+        }
+        // Sometimes without final newline
+        if (round % 3 == 0)
+            text.chop(1);
+
+        const char *data = text.constData();
+        const char *end = data + text.size();
+        int begin = 0;
+        forever {
+            const int expected = candidateLine(text, begin);
+            const int result = int(Prefilter::nextCandidateLine(data + begin, end) - data);
+            QCOMPARE(result, expected);
+            if (expected == text.size())
+                break;
+            begin = text.indexOf('\n', expected);
+            if (begin < 0)
+                break;
+            ++begin;
+        }
+    }
+}
+
+void TestGibs::testChecksum()
+{
+    const QByteArray data("int main() { return 0; }\n");
+    const QByteArray checksum(Checksum::hash(data.constData(), data.size()));
+    QVERIFY(!checksum.isEmpty());
+    QCOMPARE(Checksum::hash(data.constData(), data.size()), checksum);
+    QVERIFY(Checksum::hash(data.constData(), data.size() - 1) != checksum);
+    QVERIFY(!QString(Checksum::algorithm()).isEmpty());
+
+    const QString path(mDir.filePath("checksum.cpp"));
+    QVERIFY(writeFile(path, data));
+    QCOMPARE(Checksum::fileHash(path), checksum);
+
+    const QString emptyPath(mDir.filePath("empty.cpp"));
+    QVERIFY(writeFile(emptyPath, QByteArray()));
+    QCOMPARE(Checksum::fileHash(emptyPath), Checksum::hash(nullptr, 0));
+
+    QVERIFY(Checksum::fileHash(mDir.filePath("missing.cpp")).isEmpty());
+}
+
+void TestGibs::testReadDepfile()
+{
+    const QString path(mDir.filePath("main.d"));
+    QVERIFY(writeFile(path, "main.o: main.cpp src/a.h \\\n  src/with\\ space.h\n"
+                            "src/a.h:\n"));
+    QCOMPARE(Gibs::readDepfile(path),
+             QStringList({ "main.cpp", "src/a.h", "src/with space.h" }));
+
+    // Source piped through standard input
+    QVERIFY(writeFile(path, "main.o: - main_pch.h src/a.h"));
+    QCOMPARE(Gibs::readDepfile(path), QStringList({ "main_pch.h", "src/a.h" }));
+
+    QVERIFY(Gibs::readDepfile(mDir.filePath("missing.d")).isEmpty());
+}
+
+void TestGibs::testCacheBundle()
+{
+    const QString first(mDir.filePath("first.o"));
+    const QString second(mDir.filePath("second.o"));
+    QVERIFY(writeFile(first, "first object"));
+    QVERIFY(writeFile(second, QByteArray()));
+
+    const QString path(mDir.filePath("roundtrip.bundle"));
+    {
+        CacheBundle bundle(path);
+        bundle.addFile("objects/b.o", first);
+        bundle.addFile("objects/a.o", second);
+        bundle.addFile("objects/b.o", first);
+        QVERIFY(bundle.write());
+    }
+
+    CacheBundle bundle(path);
+    QVERIFY(bundle.open());
+    QCOMPARE(bundle.count(), 2);
+    QCOMPARE(bundle.name(0), QString("objects/a.o"));
+    QCOMPARE(bundle.name(1), QString("objects/b.o"));
+    QCOMPARE(bundle.data(0), QByteArray());
+    QCOMPARE(bundle.data(1), QByteArray("first object"));
+    QCOMPARE(bundle.indexOf("objects/b.o"), 1);
+    QCOMPARE(bundle.indexOf("objects/c.o"), -1);
+    QVERIFY(bundle.name(2).isEmpty());
+    QVERIFY(bundle.data(-1).isEmpty());
+
+    // Files which cannot be read are not silently left out
+    CacheBundle incomplete(mDir.filePath("incomplete.bundle"));
+    incomplete.addFile("a.o", mDir.filePath("missing.o"));
+    QVERIFY(!incomplete.write());
+    QVERIFY(!QFile::exists(mDir.filePath("incomplete.bundle")));
+}
+
+void TestGibs::testCacheBundleBounds()
+{
+    const QString object(mDir.filePath("bounds.o"));
+    QVERIFY(writeFile(object, "some object data"));
+
+    const QString path(mDir.filePath("bounds.bundle"));
+    CacheBundle writer(path);
+    writer.addFile("bounds.o", object);
+    QVERIFY(writer.write());
+
+    QFile file(path);
+    QVERIFY(file.open(QFile::ReadOnly));
+    const QByteArray valid(file.readAll());
+    file.close();
+
+    const auto opens = [this](const QByteArray &contents) {
+        const QString corrupted(mDir.filePath("corrupted.bundle"));
+        QFile::remove(corrupted);
+        if (!writeFile(corrupted, contents))
+            return true;
+        CacheBundle bundle(corrupted);
+        return bundle.open();
+    };
+
+    QVERIFY(opens(valid));
+    // Shorter than header
+    QVERIFY(!opens(valid.left(16)));
+    // Data cut off
+    QVERIFY(!opens(valid.left(valid.size() - 1)));
+
+    // Wrong magic
+    QByteArray wrongMagic(valid);
+    wrongMagic[0] = 'X';
+    QVERIFY(!opens(wrongMagic));
+
+    // Size of first file (in its index record) points past the end
+    QByteArray wrongSize(valid);
+    wrongSize[32 + 24 + 4] = char(0x7f);
+    QVERIFY(!opens(wrongSize));
+
+    // More files than index records
+    QByteArray wrongCount(valid);
+    wrongCount[12] = char(0x10);
+    QVERIFY(!opens(wrongCount));
+}
+
+void TestGibs::testObjectCacheNormalized()
+{
+    TestObjectCache cache(mDir.filePath("cache"), 0);
+    cache.setPathPrefix("SRC", "/home/user/project");
+    cache.setPathPrefix("BUILD", "/home/user/project/build");
+    cache.setPathPrefix("ROOT", "/");
+
+    QCOMPARE(cache.normalized("/home/user/project"), QString("@SRC@"));
+    QCOMPARE(cache.normalized("-I/home/user/project/src"), QString("-I@SRC@/src"));
+    QCOMPARE(cache.normalized("-ffile-prefix-map=/home/user/project=."),
+             QString("-ffile-prefix-map=@SRC@=."));
+    QCOMPARE(cache.normalized("/home/user/project/build/main.o"),
+             QString("@BUILD@/main.o"));
+    QCOMPARE(cache.normalized("a.h /home/user/project/b.h\n/home/user/project:"),
+             QString("a.h @SRC@/b.h\n@SRC@:"));
+    // Only whole path components are replaced
+    QCOMPARE(cache.normalized("/home/user/project2/a.h"),
+             QString("/home/user/project2/a.h"));
+    QCOMPARE(cache.normalized("/usr/include/stdio.h"), QString("/usr/include/stdio.h"));
+}
+
+void TestGibs::testFileIndex()
+{
+    const QString root(mDir.filePath("index"));
+    QVERIFY(QDir().mkpath(root + "/sub/deeper"));
+    QVERIFY(writeFile(root + "/a.h", "a"));
+    QVERIFY(writeFile(root + "/sub/deeper/b.h", "b"));
+
+    FileIndex index;
+    index.update(root);
+    QVERIFY(index.exists(root + "/a.h"));
+    QVERIFY(index.exists(root + "/sub/deeper/b.h"));
+    QVERIFY(index.exists(root + "/sub/../a.h"));
+    QVERIFY(index.exists(root + "/sub"));
+    QVERIFY(!index.exists(root + "/missing.h"));
+    QVERIFY(!index.exists(root + "/missing/a.h"));
+    QVERIFY(index.containsUnder(root, "deeper/b.h"));
+    QVERIFY(index.containsUnder(root + "/sub", "b.h"));
+    QVERIFY(!index.containsUnder(root + "/sub", "a.h"));
+
+    // Index answers for indexed directories, until it is updated
+    QVERIFY(writeFile(root + "/new.h", "new"));
+    QVERIFY(!index.exists(root + "/new.h"));
+
+    // Paths outside of the index are checked on disk
+    const QString outside(mDir.filePath("outside.h"));
+    QVERIFY(writeFile(outside, "outside"));
+    QVERIFY(index.exists(outside));
+
+    // Index can be restored from cache
+    FileIndex restored;
+    restored.fromJson(index.toJson());
+    QVERIFY(restored.exists(root + "/sub/deeper/b.h"));
+    QVERIFY(!restored.exists(root + "/missing.h"));
+}
+
 QTEST_MAIN(TestGibs)
 
 #include "tst_gibs.moc"
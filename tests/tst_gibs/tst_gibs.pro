@@ -12,6 +12,7 @@ CONFIG   += console
 CONFIG   -= app_bundle
 
 TEMPLATE = app
+CONFIG += c++14
 
 # The following define makes your compiler emit warnings if you use
 # any feature of Qt which as been marked as deprecated (the exact warnings
@@ -24,4 +25,31 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-SOURCES += tst_gibs.cpp
+# Classes under test are compiled in directly, gibs is an application
+GIBS_SRC = $$PWD/../../gibs/src
+INCLUDEPATH += $$GIBS_SRC
+DEFINES *= QT_USE_QSTRINGBUILDER
+
+# Same checksum algorithm as in gibs.pro
+xxh3 {
+    DEFINES += GIBS_CHECKSUM_XXH3
+    LIBS += -lxxhash
+} else:blake3 {
+    DEFINES += GIBS_CHECKSUM_BLAKE3
+    LIBS += -lblake3
+}
+
+HEADERS += $$GIBS_SRC/prefilter.h \
+    $$GIBS_SRC/checksum.h \
+    $$GIBS_SRC/gibs.h \
+    $$GIBS_SRC/cachebundle.h \
+    $$GIBS_SRC/objectcache.h \
+    $$GIBS_SRC/fileindex.h
+
+SOURCES += tst_gibs.cpp \
+    $$GIBS_SRC/prefilter.cpp \
+    $$GIBS_SRC/checksum.cpp \
+    $$GIBS_SRC/gibs.cpp \
+    $$GIBS_SRC/cachebundle.cpp \
+    $$GIBS_SRC/objectcache.cpp \
+    $$GIBS_SRC/fileindex.cpp